@@ -25,6 +25,7 @@ Features:
 - Check if a key is currently pressed.
 - Press, hold, and release keyboard keys.
 - Type text strings with automatic character mapping.
+- Hotstrings: typed trigger sequences replaced with text (Linux).
 - Move the mouse relative to its current position.
 - Map between human-readable keys and system key codes.
 - Thread-safe key state tracking.
@@ -82,9 +83,37 @@ Notes:
 #include <atomic>
 #include <cstring>
 #include <iostream>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <climits>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iterator>
+#include <string_view>
+#include <array>
+#include <type_traits>
+#include <deque>
+
+// Coroutine macros need C++20 and a standard library that ships <coroutine>
+#if defined(__has_include) && (__cplusplus >= 202002L || (defined(_MSVC_LANG) && _MSVC_LANG >= 202002L))
+#if __has_include(<coroutine>)
+#include <coroutine>
+#include <exception>
+#define INPCTRL_COROUTINES 1
+#endif
+#endif
 
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN 
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
     #include <windows.h>
 #else
     #include <linux/input-event-codes.h>
@@ -93,7 +122,27 @@ Notes:
     #include <unistd.h>
     #include <dirent.h>
     #include <sys/ioctl.h>
-    #include <vector>
+    #include <poll.h>
+    #include <time.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <sys/epoll.h>
+    #include <sys/eventfd.h>
+    #include <sys/timerfd.h>
+    #include <pthread.h>
+    #include <sched.h>
+    #include <alloca.h>
+    #include <sys/uio.h>
+    #include <sys/syscall.h>
+    #if defined(__has_include)
+    #if __has_include(<linux/io_uring.h>)
+    #include <linux/io_uring.h>
+    #endif
+    #endif
+    // The io_uring backend needs io_uring_getevents_arg (Linux 5.11 headers)
+    #if defined(IORING_ENTER_EXT_ARG) && defined(__NR_io_uring_setup)
+    #define INPCTRL_IO_URING 1
+    #endif
 #endif
 
 class CrossInput {
@@ -189,6 +238,140 @@ public:
 
     };
 
+    // Which transition of a trigger key a rule reacts to
+    enum class KeyEdge { Down, Up, Both };
+
+    // Chatter filter applied to physical key events.
+    // Eager: the first edge passes at once, changes within the threshold
+    // after it are suppressed. Deferred: an edge passes only once the key
+    // has been stable for the threshold.
+    enum class DebounceMode { Off, Eager, Deferred };
+
+    // Output step of a listener rule
+    enum class RuleOp { Hold, Release, Tap };
+
+    struct RuleAction {
+        RuleOp op;
+        Key key;
+    };
+
+    // A monitor of the desktop, in desktop pixel coordinates
+    struct Monitor {
+        int x = 0;
+        int y = 0;
+        int width = 0;
+        int height = 0;
+    };
+
+    // How capture, timed actions and injection are threaded
+    enum class Mode {
+        Threaded,  // listener thread, scheduler thread started on demand
+        Reactor,   // Linux: a single thread runs everything on one epoll loop
+        Manual     // no threads, the application calls pump()
+    };
+
+    // Scheduling policy of the threads CrossInput owns
+    enum class SchedPolicy {
+        Other,      // the normal time-sharing scheduler
+        Fifo,       // SCHED_FIFO
+        RoundRobin  // SCHED_RR
+    };
+
+    // Settings applied by init()
+    struct Options {
+        // Screen layout used by moveMouseTo(). On Linux a non-empty list also
+        // creates the absolute pointer device; on Windows it is filled in
+        // from the system when left empty.
+        std::vector<Monitor> monitors;
+        
+        // Linux: advertise EV_REP on the virtual keyboard so the kernel
+        // repeats held keys itself (see setAutoRepeat)
+        bool kernelRepeat = false;
+        
+        // Threading model; Reactor falls back to Threaded on Windows or
+        // when the epoll set cannot be created
+        Mode mode = Mode::Threaded;
+        
+        // Core the reactor thread is pinned to, -1 for no pinning
+        int reactorCpu = -1;
+        
+        // Linux real-time settings for the listener, reactor, scheduler and
+        // recording threads. If one cannot be applied init() fails and
+        // getRealtimeStatus() says why.
+        SchedPolicy schedPolicy = SchedPolicy::Other;
+        int schedPriority = 0;      // 1-99 with Fifo or RoundRobin
+        std::vector<int> cpus;      // affinity mask, empty for any core
+        bool lockMemory = false;    // mlockall() current and future pages
+        size_t prefaultBytes = 0;   // stack each thread touches at start
+        bool nameThreads = true;    // inpctrl-listen, inpctrl-sched, ...
+        
+        // Linux: after input arrives, the listener (or reactor) keeps polling
+        // without sleeping for this long before blocking again. 0 = always block.
+        unsigned int spinUs = 0;
+        
+        // Linux, Reactor and Manual modes: read devices and write uinput
+        // through io_uring instead of epoll, read() and write(). Falls back
+        // to epoll when io_uring is unavailable.
+        bool ioUring = false;
+    };
+
+    // Outcome of the real-time options. `error` names the first setting
+    // that could not be applied and why.
+    struct RealtimeStatus {
+        bool ok = true;
+        std::string error;
+    };
+
+    // Timing curve of a generated mouse path
+    enum class PathCurve { Linear, EaseIn, EaseOut, EaseInOut };
+
+    // Handle of an action running on the shared scheduler thread
+    using TaskId = uint64_t;
+
+    // Result of an autoclick run. Jitter is the standard deviation of the
+    // click-to-click interval.
+    struct AutoclickStats {
+        uint64_t clicks = 0;
+        double targetCps = 0.0;
+        double achievedCps = 0.0;
+        double intervalJitterUs = 0.0;
+        double maxIntervalErrorUs = 0.0;  // worst |interval - target interval|
+    };
+
+    // Relative pointer and wheel motion, in device units (wheel in notches)
+    struct MouseDelta {
+        int64_t dx = 0;
+        int64_t dy = 0;
+        int64_t wheel = 0;
+        int64_t hwheel = 0;
+    };
+
+    // Snapshot of a latency distribution. Bucket i counts samples below
+    // 2^i microseconds; the last bucket also holds everything slower.
+    struct LatencyHistogram {
+        static constexpr int kBuckets = 20;
+        uint64_t count = 0;
+        uint64_t totalNs = 0;
+        uint64_t minNs = 0;
+        uint64_t maxNs = 0;
+        uint64_t buckets[kBuckets] = {};
+
+        double averageUs() const {
+            return count ? static_cast<double>(totalNs) / count / 1000.0 : 0.0;
+        }
+
+        // Upper bound (in microseconds) of the bucket holding the p-th percentile
+        uint64_t percentileUs(double p) const {
+            uint64_t target = static_cast<uint64_t>(p / 100.0 * count);
+            uint64_t seen = 0;
+            for (int i = 0; i < kBuckets; ++i) {
+                seen += buckets[i];
+                if (seen > target) return 1ULL << i;
+            }
+            return 1ULL << (kBuckets - 1);
+        }
+    };
+
     CrossInput() : m_running(false), m_initialized(false) {
 #ifdef _WIN32
         m_hookHandle = NULL;
@@ -203,7 +386,19 @@ public:
 
     // Initialize the input system
     bool init() {
+        return init(Options());
+    }
+
+    bool init(Mode mode) {
+        Options options;
+        options.mode = mode;
+        return init(options);
+    }
+
+    bool init(const Options& options) {
         if (m_initialized) return true;
+        m_options = options;
+        if (!applyProcessRealtime()) return false;
         
 #ifdef _WIN32
         return initWindows();
@@ -214,6 +409,13 @@ public:
 
     // Cleanup resources
     void cleanup() {
+#ifndef _WIN32
+        // The reactor runs the timed actions, so it stops before they wind down
+        stopReactor();
+#endif
+        // Timed actions release what they hold while the device still exists
+        stopScheduler();
+        
         if (!m_initialized) return;
         
         m_running = false;
@@ -231,6 +433,87 @@ public:
         m_initialized = false;
     }
 
+    // Manual mode: wait up to timeoutMs (0 polls, -1 blocks) for input or
+    // the next timed action, then handle it on the calling thread. Callbacks
+    // fire, due tasks run and queued output is flushed before returning.
+    // Returns false unless initialized with Mode::Manual.
+    bool pump(int timeoutMs = 0) {
+        if (!m_initialized || m_options.mode != Mode::Manual) return false;
+#ifdef _WIN32
+        pumpWindows(timeoutMs);
+#else
+        // Output injected during the pass joins its single write
+        m_reactorThread = std::this_thread::get_id();
+        reactorPass(timeoutMs);
+        reactorSubmit();
+        m_reactorThread = std::thread::id();
+#endif
+        return true;
+    }
+
+    // Linux: epoll fd that becomes readable when pump() has work, for
+    // external event loops. -1 on Windows, where pump() waits on the
+    // thread's message queue, and outside Manual and Reactor modes.
+    int getFd() const {
+#if defined(_WIN32)
+        return -1;
+#elif defined(INPCTRL_IO_URING)
+        return m_uring.fd >= 0 ? m_uring.fd : m_reactorFd;
+#else
+        return m_reactorFd;
+#endif
+    }
+
+    // Whether the real-time options given to init() took effect. Threads
+    // started later (scheduler, recording) report failures here as well.
+    RealtimeStatus getRealtimeStatus() const {
+        std::lock_guard<std::mutex> lock(m_rtMutex);
+        return m_rtStatus;
+    }
+
+    // How late timed actions start, from their deadline to the scheduler
+    // (or reactor) wakeup that runs them
+    LatencyHistogram getTimerLatency() const {
+        return m_timerLatency.snapshot();
+    }
+
+#ifndef _WIN32
+    // Input pickup latency, from the kernel timestamp of the first event in
+    // a read to the listener handling it
+    LatencyHistogram getPickupLatency() const {
+        return m_pickupLatency.snapshot();
+    }
+
+    // Where the listener spent its time waiting under Options::spinUs
+    struct PollStats {
+        double spinSeconds = 0.0;     // busy-polling after recent input
+        double blockedSeconds = 0.0;  // asleep in ppoll / epoll_wait
+        uint64_t spinWakeups = 0;     // polls that found work while spinning
+        uint64_t blockedWakeups = 0;  // wakeups from a blocking wait
+    };
+
+    PollStats getPollStats() const {
+        PollStats stats;
+        stats.spinSeconds = m_spinNs.load(std::memory_order_relaxed) / 1e9;
+        stats.blockedSeconds = m_blockNs.load(std::memory_order_relaxed) / 1e9;
+        stats.spinWakeups = m_spinWakeups.load(std::memory_order_relaxed);
+        stats.blockedWakeups = m_blockWakeups.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    void resetPollStats() {
+        m_spinNs = 0;
+        m_blockNs = 0;
+        m_spinWakeups = 0;
+        m_blockWakeups = 0;
+    }
+#endif
+
+    void resetThreadLatency() {
+        m_timerLatency.reset();
+        m_pickupLatency.reset();
+    }
+
     // Check if a key is currently pressed
     bool isKeyPressed(Key key) {
         unsigned int code = static_cast<unsigned int>(key);
@@ -245,6 +528,10 @@ public:
 
     // Press and hold a key
     void holdKey(Key key) {
+        if (isMouseButton(key)) {
+            holdButton(key);
+            return;
+        }
         unsigned int code = static_cast<unsigned int>(key);
 #ifdef _WIN32
         holdKeyWindows(code);
@@ -255,6 +542,10 @@ public:
 
     // Release a key
     void releaseKey(Key key) {
+        if (isMouseButton(key)) {
+            releaseButton(key);
+            return;
+        }
         unsigned int code = static_cast<unsigned int>(key);
 #ifdef _WIN32
         releaseKeyWindows(code);
@@ -270,706 +561,6356 @@ public:
         releaseKey(key);
     }
 
-    // Type a string of text
-    void typeText(const std::string& text, int delayBetweenKeys = 30) {
-        for (char c : text) {
-            typeChar(c, delayBetweenKeys);
-        }
+    // Press and hold a mouse button (Key::LMB, RMB, MMB, Mouse4 or Mouse5)
+    void holdButton(Key button) {
+        if (!isMouseButton(button)) return;
+        EventBatch batch;
+        queueButton(batch, button, true);
+        endReport(batch);
+        emitBatch(batch);
     }
 
-    // Move mouse relative to current position
-    void moveMouse(int dx, int dy) {
-#ifdef _WIN32
-        moveMouseWindows(dx, dy);
-#else
-        moveMouseLinux(dx, dy);
-#endif
+    // Release a mouse button
+    void releaseButton(Key button) {
+        if (!isMouseButton(button)) return;
+        EventBatch batch;
+        queueButton(batch, button, false);
+        endReport(batch);
+        emitBatch(batch);
     }
 
-    // Get human-readable key name
-    std::string getKeyName(Key key) {
-        unsigned int code = static_cast<unsigned int>(key);
+    // Click a mouse button: press and release reports sent in one batch
+    void click(Key button = Key::LMB) {
+        if (!isMouseButton(button)) return;
+        EventBatch batch;
+        queueClick(batch, button);
+        emitBatch(batch);
+    }
+
+    // Click `count` times, one click every `intervalMs` on absolute deadlines
+    void multiClick(Key button, int count, int intervalMs = 50) {
+        if (!isMouseButton(button)) return;
+        auto due = std::chrono::steady_clock::now();
+        for (int i = 0; i < count; ++i) {
+            std::this_thread::sleep_until(due);
+            click(button);
+            due += std::chrono::milliseconds(intervalMs);
+        }
+    }
+
+    // Click `button` at `cps` clicks per second on the scheduler thread
+    // until cancelTask() is called. Stats stay available after it stops.
+    TaskId startAutoclick(Key button, double cps) {
+        if (!isMouseButton(button) || cps <= 0.0) return 0;
         
-        static std::unordered_map<unsigned int, std::string> names = {
-            {0x41, "A"}, {0x42, "B"}, {0x43, "C"}, {0x44, "D"}, {0x45, "E"},
-            {0x46, "F"}, {0x47, "G"}, {0x48, "H"}, {0x49, "I"}, {0x4A, "J"},
-            {0x4B, "K"}, {0x4C, "L"}, {0x4D, "M"}, {0x4E, "N"}, {0x4F, "O"},
-            {0x50, "P"}, {0x51, "Q"}, {0x52, "R"}, {0x53, "S"}, {0x54, "T"},
-            {0x55, "U"}, {0x56, "V"}, {0x57, "W"}, {0x58, "X"}, {0x59, "Y"},
-            {0x5A, "Z"}, 
-            {0x30, "0"}, {0x31, "1"}, {0x32, "2"}, {0x33, "3"}, {0x34, "4"},
-            {0x35, "5"}, {0x36, "6"}, {0x37, "7"}, {0x38, "8"}, {0x39, "9"},
-            {0x20, "Space"}, {0x0D, "Enter"}, {0x09, "Tab"},
-            {0x1B, "Escape"}, {0x08, "Backspace"}, {0x2E, "Delete"}, {0x2D, "Insert"},
-            {0x70, "F1"}, {0x71, "F2"}, {0x72, "F3"},
-            {0x73, "F4"}, {0x74, "F5"}, {0x75, "F6"}, {0x76, "F7"},
-            {0x77, "F8"}, {0x78, "F9"}, {0x79, "F10"}, {0x7A, "F11"},
-            {0x7B, "F12"}, 
-            {0xDB, "["}, {0xDD, "]"}, 
-            {0xBF, "/"}, {0xBA, ";"}, 
-            {0xBD, "-"}, {0xBB, "="}, {0xDC, "\\"}, 
-            {0xDE, "'"}, {0xBC, ","}, {0xBE, "."}, {0xC0, "`"},
-            {0x25, "Left"}, {0x26, "Up"}, {0x27, "Right"}, {0x28, "Down"},
-            {0xA0, "LShift"}, {0xA1, "RShift"}, 
-            {0xA2, "LCtrl"}, {0xA3, "RCtrl"},
-            {0xA4, "LAlt"}, {0xA5, "RAlt"},
-            // Mouse buttons
-            {0x01, "LMB"}, {0x02, "RMB"}, {0x04, "MMB"},
-            {0x05, "Mouse4"}, {0x06, "Mouse5"}, // Navigation keys
-            {0x24, "Home"}, {0x23, "End"}, {0x21, "PageUp"}, {0x22, "PageDown"},
-            // Numpad
-            {0x60, "Numpad0"}, {0x61, "Numpad1"}, {0x62, "Numpad2"}, {0x63, "Numpad3"},
-            {0x64, "Numpad4"}, {0x65, "Numpad5"}, {0x66, "Numpad6"}, {0x67, "Numpad7"},
-            {0x68, "Numpad8"}, {0x69, "Numpad9"},
-            {0x6A, "Numpad*"}, {0x6B, "Numpad+"}, {0x6D, "Numpad-"},
-            {0x6E, "Numpad."}, {0x6F, "Numpad/"},
-            // Lock keys
-            {0x14, "CapsLock"}, {0x90, "NumLock"}, {0x91, "ScrollLock"},
-            // System keys
-            {0x2C, "PrintScreen"}, {0x13, "Pause"},
-            // Windows key
-            {0x5B, "LWin"}, {0x5C, "RWin"},
+        auto state = std::make_shared<AutoclickState>();
+        state->targetCps = cps;
+        state->interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(1.0 / cps));
+        
+        auto run = [this, button, state](SchedClock::time_point& due, EventBatch& batch) {
+            queueClick(batch, button);
+            auto now = SchedClock::now();
+            state->recordClick(now);
+            due = catchUp(due, now) + state->interval;
+            return true;
         };
+        TaskId id = scheduleTask(SchedClock::now(), run);
         
-        if (names.count(code)) {
-            return names[code];
+        std::lock_guard<std::mutex> lock(m_schedMutex);
+        if (m_schedTasks.count(id)) {
+            m_autoclicks[id] = state;
+        } else {
+            keepFinishedAutoclick(id, state->stats());  // already cancelled
         }
-        return "Unknown";
+        return id;
     }
 
-    //A function that gets the current pressed key.
-    Key getCurrentPressedKey(int timeout_ms = 0) {
-#ifdef _WIN32
-        return getCurrentPressedKeyWindows(timeout_ms);
-#else
-        return getCurrentPressedKeyLinux(timeout_ms);
-#endif
+    AutoclickStats getAutoclickStats(TaskId id) {
+        std::shared_ptr<AutoclickState> state;
+        {
+            std::lock_guard<std::mutex> lock(m_schedMutex);
+            auto it = m_autoclicks.find(id);
+            if (it == m_autoclicks.end()) {
+                auto done = m_finishedAutoclicks.find(id);
+                return done != m_finishedAutoclicks.end() ? done->second : AutoclickStats();
+            }
+            state = it->second;
+        }
+        return state->stats();
     }
 
-private:
-    std::unordered_map<unsigned int, bool> m_keyStates;
-    std::mutex m_keyMutex;
-    std::thread m_listenerThread;
-    std::atomic<bool> m_running;
-    bool m_initialized;
+    // ==================== TURBO ====================
+    // Hold: fire while the trigger is held. Toggle: each press of the
+    // trigger switches firing on or off.
+    enum class TurboTrigger { Hold, Toggle };
 
-    // Type a single character
-    void typeChar(char c, int delayMs = 30) {
+    struct TurboStats {
+        uint64_t taps = 0;
+        double targetHz = 0.0;
+        double achievedHz = 0.0;  // taps per second of active time
+        bool active = false;
+    };
+
+    // Tap `output` at `rateHz` while the binding is active. `jitter` varies
+    // each interval by up to that fraction (0 to 0.5). The output is held
+    // for half of each interval. All bindings run on one scheduler task
+    // and their edges due together share a report. The task is started by
+    // the trigger edges the listener sees and ends once nothing fires.
+    int addTurbo(Key trigger, Key output, double rateHz,
+                 TurboTrigger mode = TurboTrigger::Hold, double jitter = 0.0) {
+        if (rateHz <= 0.0 || rateHz > 1000.0) return 0;
+        auto binding = std::make_shared<TurboBinding>();
+        binding->trigger = trigger;
+        binding->output = output;
+        binding->mode = mode;
+        binding->rateHz = rateHz;
+        binding->jitter = std::max(0.0, std::min(jitter, 0.5));
+        
+        std::lock_guard<std::mutex> lock(m_turboMutex);
+        binding->id = m_nextTurboId++;
+        binding->rng = static_cast<uint32_t>(binding->id) * 2654435761u + 1;
+        m_turbo.push_back(binding);
+        m_turboBindings.store(m_turbo.size(), std::memory_order_relaxed);
+        // A trigger already held counts as its first edge
+        if (isKeyPressed(trigger) && applyTurboTrigger(*binding, true, SchedClock::now())) {
+            kickTurbo();
+        }
 #ifdef _WIN32
-        typeCharWindows(c, delayMs);
-#else
-        typeCharLinux(c, delayMs);
+        if (isMouseButton(trigger)) kickTurbo();
 #endif
+        return binding->id;
     }
 
-#ifdef _WIN32
-    // ==================== WINDOWS IMPLEMENTATION ====================
-    HHOOK m_hookHandle;
-    
-    static CrossInput* s_instance;  // Declaration only
-    
-    static LRESULT CALLBACK keyboardHookProc(int nCode, WPARAM wParam, LPARAM lParam) {
-        if (nCode == HC_ACTION && s_instance) {
-            const KBDLLHOOKSTRUCT* pkbhs = reinterpret_cast<const KBDLLHOOKSTRUCT*>(lParam);
-            
-            // Only track non-injected keys
-            if ((pkbhs->flags & LLKHF_INJECTED) == 0) {
-                bool isDown = (wParam == WM_KEYDOWN || wParam == WM_SYSKEYDOWN);
-                
-                std::lock_guard<std::mutex> lock(s_instance->m_keyMutex);
-                s_instance->m_keyStates[pkbhs->vkCode] = isDown;
+    // The output is released on the engine's next tick if it was down
+    bool removeTurbo(int id) {
+        std::lock_guard<std::mutex> lock(m_turboMutex);
+        for (auto& binding : m_turbo) {
+            if (binding->id == id && !binding->removed) {
+                binding->removed = true;
+                dropRemovedTurbo();
+                return true;
             }
         }
-        return CallNextHookEx(s_instance->m_hookHandle, nCode, wParam, lParam);
+        return false;
     }
-    
-    bool initWindows() {
-        s_instance = this;
-        
-        // Install keyboard hook
-        m_hookHandle = SetWindowsHookEx(
-            WH_KEYBOARD_LL, 
-            keyboardHookProc, 
-            GetModuleHandle(NULL), 
-            0
-        );
-        
-        if (!m_hookHandle) {
-            std::cerr << "Failed to install keyboard hook. Error: " << GetLastError() << std::endl;
-            return false;
+
+    void clearTurbo() {
+        std::lock_guard<std::mutex> lock(m_turboMutex);
+        for (auto& binding : m_turbo) binding->removed = true;
+        dropRemovedTurbo();
+    }
+
+    TurboStats getTurboStats(int id) {
+        std::lock_guard<std::mutex> lock(m_turboMutex);
+        for (const auto& binding : m_turbo) {
+            if (binding->id != id) continue;
+            TurboStats stats;
+            stats.taps = binding->taps;
+            stats.targetHz = binding->rateHz;
+            stats.active = binding->active;
+            double seconds = binding->activeSeconds;
+            if (binding->active) {
+                seconds += std::chrono::duration<double>(SchedClock::now() - binding->activeSince).count();
+            }
+            stats.achievedHz = seconds > 0 ? binding->taps / seconds : 0.0;
+            return stats;
         }
-        
-        m_running = true;
-        
-        // Start message pump thread for the hook
-        m_listenerThread = std::thread([this]() { 
-            windowsEventLoop(); 
-        });
-        
-        m_initialized = true;
-        std::cout << "Windows input initialized (using GetAsyncKeyState + hook)" << std::endl;
+        return TurboStats();
+    }
+
+    // Stop a scheduled action. Whatever it was holding is released.
+    bool cancelTask(TaskId id) {
+        std::lock_guard<std::mutex> lock(m_schedMutex);
+        auto it = m_schedTasks.find(id);
+        if (it == m_schedTasks.end()) return false;
+        it->second->cancelled = true;
+        // Handle the cancellation right away rather than at the next deadline
+        pushSchedEntry(SchedClock::now(), id);
+        wakeScheduler();
         return true;
     }
-    
-    void cleanupWindows() {
-        if (m_hookHandle) {
-            UnhookWindowsHookEx(m_hookHandle);
-            m_hookHandle = NULL;
-        }
-        s_instance = nullptr;
+
+    bool isTaskActive(TaskId id) {
+        std::lock_guard<std::mutex> lock(m_schedMutex);
+        return m_schedTasks.count(id) != 0;
     }
-    
-    void windowsEventLoop() {
-        MSG msg;
-        // Process messages to keep hook alive
-        while (m_running) {
-            while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
-                TranslateMessage(&msg);
-                DispatchMessage(&msg);
+
+    // Block until a scheduled action has finished or been cancelled
+    void waitTask(TaskId id) {
+        std::unique_lock<std::mutex> lock(m_schedMutex);
+        m_schedDoneCv.wait(lock, [&]() { return m_schedTasks.count(id) == 0; });
+    }
+
+    // ==================== MACROS ====================
+    // A macro is a flat byte string of instructions, little-endian operands:
+    //   Press/Release/Tap  key:u16             (Key value)
+    //   Chord              n:u8 key:u16 x n    (press all, then release all)
+    //   Move               dx:i32 dy:i32
+    //   Wait               us:u32
+    //   Repeat             count:u16           (0 = forever)
+    //   Next               target:u32          (back to the loop body)
+    //   WaitKey            key:u16 down:u8 timeoutMs:u32 (0 = no timeout)
+    //   IfKey              key:u16 down:u8 elseTarget:u32
+    //   Jump               target:u32
+    //   Reports            n:u16 edge:u16 x n  (key | down << 8 | end of report << 9)
+    // Targets are byte offsets. Code ends with End.
+    enum class MacroOp : uint8_t {
+        End = 0,
+        Press,
+        Release,
+        Tap,
+        Chord,
+        Move,
+        Wait,
+        Repeat,
+        Next,
+        WaitKey,
+        IfKey,
+        Jump,
+        Reports,
+    };
+
+    using MacroCode = std::vector<uint8_t>;
+
+    static constexpr int kMacroLoopDepth = 8;
+    static constexpr int kMacroChordKeys = 8;
+
+    // One key edge of a prebuilt Reports instruction
+    struct MacroEdge {
+        Key key;
+        bool down;
+        bool endReport;  // close the report after this edge
+    };
+
+    // Assembles macro bytecode, resolving loop and branch targets
+    class MacroBuilder {
+    public:
+        MacroBuilder& press(Key key) { return keyOp(MacroOp::Press, key); }
+        MacroBuilder& release(Key key) { return keyOp(MacroOp::Release, key); }
+        MacroBuilder& tap(Key key) { return keyOp(MacroOp::Tap, key); }
+
+        MacroBuilder& chord(std::initializer_list<Key> keys) {
+            return chord(std::vector<Key>(keys));
+        }
+
+        MacroBuilder& chord(const std::vector<Key>& keys) {
+            size_t n = std::min<size_t>(keys.size(), kMacroChordKeys);
+            op(MacroOp::Chord);
+            put<uint8_t>(static_cast<uint8_t>(n));
+            for (size_t i = 0; i < n; ++i) put<uint16_t>(static_cast<uint16_t>(keys[i]));
+            return *this;
+        }
+
+        // Key edges sent back to back by one instruction
+        MacroBuilder& reports(const std::vector<MacroEdge>& edges) {
+            for (size_t first = 0; first < edges.size(); first += 0xFFFF) {
+                size_t n = std::min<size_t>(edges.size() - first, 0xFFFF);
+                op(MacroOp::Reports);
+                put<uint16_t>(static_cast<uint16_t>(n));
+                for (size_t i = first; i < first + n; ++i) {
+                    put<uint16_t>(static_cast<uint16_t>((static_cast<unsigned int>(edges[i].key) & 0xFF) |
+                                                        (edges[i].down ? 0x100 : 0) |
+                                                        (edges[i].endReport ? 0x200 : 0)));
+                }
             }
-            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            return *this;
         }
-    }
-    
-    void holdKeyWindows(unsigned int vkCode) {
-        INPUT input = {0};
-        input.type = INPUT_KEYBOARD;
-        
-        // For the slash key (and other OEM keys), use scan code
-        if (vkCode == 0xBF) {  // VK_OEM_2 (slash key)
-            input.ki.wScan = 0x35;  // Hardware scan code for /
-            input.ki.dwFlags = KEYEVENTF_SCANCODE;
-        } else {
-            input.ki.wVk = vkCode;
-            input.ki.wScan = MapVirtualKey(vkCode, MAPVK_VK_TO_VSC);
-            input.ki.dwFlags = 0;
+
+        MacroBuilder& move(int dx, int dy) {
+            op(MacroOp::Move);
+            put<int32_t>(dx);
+            put<int32_t>(dy);
+            return *this;
         }
-        
-        SendInput(1, &input, sizeof(INPUT));
-    }
 
-    void releaseKeyWindows(unsigned int vkCode) {
-        INPUT input = {0};
-        input.type = INPUT_KEYBOARD;
-        
-        // For the slash key (and other OEM keys), use scan code
-        if (vkCode == 0xBF) {  // VK_OEM_2 (slash key)
-            input.ki.wScan = 0x35;  // Hardware scan code for /
-            input.ki.dwFlags = KEYEVENTF_SCANCODE | KEYEVENTF_KEYUP;
-        } else {
-            input.ki.wVk = vkCode;
-            input.ki.wScan = MapVirtualKey(vkCode, MAPVK_VK_TO_VSC);
-            input.ki.dwFlags = KEYEVENTF_KEYUP;
+        MacroBuilder& wait(int ms) { return waitUs(static_cast<uint32_t>(std::max(0, ms)) * 1000); }
+
+        MacroBuilder& waitUs(uint32_t us) {
+            op(MacroOp::Wait);
+            put<uint32_t>(us);
+            return *this;
         }
-        
-        SendInput(1, &input, sizeof(INPUT));
-    }
-    
-    void moveMouseWindows(int dx, int dy) {
-        INPUT input = {0};
-        input.type = INPUT_MOUSE;
-        input.mi.dwFlags = MOUSEEVENTF_MOVE;
-        input.mi.dx = dx;
-        input.mi.dy = dy;
-        SendInput(1, &input, sizeof(INPUT));
-    }
 
-    void typeCharWindows(char c, int delayMs) {
-        // Convert char to virtual key and shift state
-        SHORT vk = VkKeyScanA(c);
-        if (vk == -1) {
-            // Character not available in current keyboard layout
-            std::cerr << "Character '" << c << "' not available in keyboard layout" << std::endl;
-            return;
+        // Repeat everything up to endLoop() `count` times, or forever with 0
+        MacroBuilder& loop(int count = 0) {
+            op(MacroOp::Repeat);
+            put<uint16_t>(static_cast<uint16_t>(std::max(0, std::min(count, 0xFFFF))));
+            m_loops.push_back(m_code.size());
+            return *this;
         }
-        
-        BYTE keyCode = LOBYTE(vk);
-        BYTE shiftState = HIBYTE(vk);
-        
-        // Press shift if needed
-        bool needShift = (shiftState & 1);
-        bool needCtrl = (shiftState & 2);
-        bool needAlt = (shiftState & 4);
-        
-        if (needShift) holdKeyWindows(VK_SHIFT);
-        if (needCtrl) holdKeyWindows(VK_CONTROL);
-        if (needAlt) holdKeyWindows(VK_MENU);
-        
-        // Press the key
-        holdKeyWindows(keyCode);
-        std::this_thread::sleep_for(std::chrono::milliseconds(delayMs));
-        releaseKeyWindows(keyCode);
-        
-        // Release modifiers
-        if (needAlt) releaseKeyWindows(VK_MENU);
-        if (needCtrl) releaseKeyWindows(VK_CONTROL);
-        if (needShift) releaseKeyWindows(VK_SHIFT);
-    }
 
-    Key getCurrentPressedKeyWindows(int timeout_ms) {
-        auto startTime = std::chrono::steady_clock::now();
-        
-        do {
-            // Check all possible virtual key codes
-            for (unsigned int vk = 0x01; vk <= 0xFE; vk++) {
-                // Check if key is pressed
-                if (GetAsyncKeyState(vk) & 0x8000) {
-                    // Wait for key to be released before returning
-                    while (GetAsyncKeyState(vk) & 0x8000) {
-                        std::this_thread::sleep_for(std::chrono::milliseconds(10));
-                    }
-                    return static_cast<Key>(vk);
-                }
+        MacroBuilder& endLoop() {
+            if (m_loops.empty()) return *this;
+            op(MacroOp::Next);
+            put<uint32_t>(static_cast<uint32_t>(m_loops.back()));
+            m_loops.pop_back();
+            return *this;
+        }
+
+        MacroBuilder& waitKey(Key key, bool down = true, int timeoutMs = 0) {
+            op(MacroOp::WaitKey);
+            put<uint16_t>(static_cast<uint16_t>(key));
+            put<uint8_t>(down ? 1 : 0);
+            put<uint32_t>(static_cast<uint32_t>(std::max(0, timeoutMs)));
+            return *this;
+        }
+
+        // Run what follows only while `key` is (or is not) held
+        MacroBuilder& ifKey(Key key, bool down = true) {
+            op(MacroOp::IfKey);
+            put<uint16_t>(static_cast<uint16_t>(key));
+            put<uint8_t>(down ? 1 : 0);
+            m_ifs.push_back(m_code.size());
+            put<uint32_t>(0);  // patched by otherwise() or endIf()
+            return *this;
+        }
+
+        MacroBuilder& otherwise() {
+            if (m_ifs.empty()) return *this;
+            op(MacroOp::Jump);
+            size_t jump = m_code.size();
+            put<uint32_t>(0);
+            patch(m_ifs.back(), m_code.size());
+            m_ifs.back() = jump;
+            return *this;
+        }
+
+        MacroBuilder& endIf() {
+            if (m_ifs.empty()) return *this;
+            patch(m_ifs.back(), m_code.size());
+            m_ifs.pop_back();
+            return *this;
+        }
+
+        // Close open blocks and terminate the code
+        MacroCode build() {
+            while (!m_ifs.empty()) endIf();
+            while (!m_loops.empty()) endLoop();
+            MacroCode code = m_code;
+            code.push_back(static_cast<uint8_t>(MacroOp::End));
+            return code;
+        }
+
+    private:
+        MacroCode m_code;
+        std::vector<size_t> m_loops;  // body start of each open loop
+        std::vector<size_t> m_ifs;    // target operand waiting for a patch
+
+        MacroBuilder& keyOp(MacroOp code, Key key) {
+            op(code);
+            put<uint16_t>(static_cast<uint16_t>(key));
+            return *this;
+        }
+
+        void op(MacroOp code) { m_code.push_back(static_cast<uint8_t>(code)); }
+
+        template<typename T>
+        void put(T value) {
+            size_t at = m_code.size();
+            m_code.resize(at + sizeof(T));
+            memcpy(&m_code[at], &value, sizeof(T));
+        }
+
+        void patch(size_t at, size_t target) {
+            uint32_t value = static_cast<uint32_t>(target);
+            memcpy(&m_code[at], &value, sizeof(value));
+        }
+    };
+
+    // Check that every opcode and operand is complete and every target
+    // lands on an instruction. Run this on code loaded from outside.
+    static bool validateMacro(const MacroCode& code, std::string* error = nullptr) {
+        auto fail = [&](const std::string& what, size_t at) {
+            if (error) *error = what + " at offset " + std::to_string(at);
+            return false;
+        };
+        std::vector<bool> starts(code.size() + 1, false);
+        std::vector<std::pair<size_t, uint32_t>> targets;
+        size_t pc = 0;
+        bool ended = false;
+        while (pc < code.size()) {
+            starts[pc] = true;
+            size_t at = pc;
+            MacroOp op = static_cast<MacroOp>(code[pc]);
+            size_t length = macroOperandBytes(code, pc);
+            if (length == SIZE_MAX) return fail("Unknown opcode", at);
+            if (pc + 1 + length > code.size()) return fail("Truncated instruction", at);
+            if (op == MacroOp::Chord && (code[pc + 1] == 0 || code[pc + 1] > kMacroChordKeys)) {
+                return fail("Bad chord size", at);
             }
-            
-            if (timeout_ms == 0) {
-                break; // No wait, check once
+            if (op == MacroOp::Next || op == MacroOp::Jump) {
+                targets.push_back({at, readMacro<uint32_t>(code, pc + 1)});
+            } else if (op == MacroOp::IfKey) {
+                targets.push_back({at, readMacro<uint32_t>(code, pc + 4)});
             }
-            
-            std::this_thread::sleep_for(std::chrono::milliseconds(10));
-            
-            if (timeout_ms > 0) {
-                auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
-                    std::chrono::steady_clock::now() - startTime
-                ).count();
-                if (elapsed >= timeout_ms) {
-                    break;
-                }
+            pc += 1 + length;
+            ended = (op == MacroOp::End);
+        }
+        if (!ended) return fail("Missing End", code.size());
+        for (const auto& target : targets) {
+            if (target.second >= code.size() || !starts[target.second]) {
+                return fail("Jump into an instruction", target.first);
             }
-            
-        } while (timeout_ms != 0);
-        
-        return static_cast<Key>(0); // No key pressed
+        }
+        return true;
     }
-#else
-    // ==================== LINUX IMPLEMENTATION ====================
-    int m_uinputFd;
-    std::vector<int> m_inputFds;
-    
-    bool initLinux() {
-        // Initialize uinput for output
-        m_uinputFd = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
-        if (m_uinputFd < 0) {
-            std::cout << "Failed to open /dev/uinput. Run with sudo!" << std::endl;
-            return true;
+
+    static MacroCode loadMacro(const std::string& path) {
+        std::ifstream in(path, std::ios::binary);
+        MacroCode code((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        std::string error;
+        if (!validateMacro(code, &error)) {
+            std::cerr << "Invalid macro " << path << ": " << error << std::endl;
+            return MacroCode();
         }
-        
-        struct uinput_setup setup;
-        memset(&setup, 0, sizeof(setup));
-        strcpy(setup.name, "CrossInput Virtual Device");
-        setup.id.bustype = BUS_USB;
-        setup.id.vendor = 0x1234;
-        setup.id.product = 0x5678;
-        setup.id.version = 1;
-        
-        // Enable key events
-        ioctl(m_uinputFd, UI_SET_EVBIT, EV_KEY);
-        for (int i = 0; i < 256; ++i) {
-            ioctl(m_uinputFd, UI_SET_KEYBIT, i);
+        return code;
+    }
+
+    static bool saveMacro(const std::string& path, const MacroCode& code) {
+        std::ofstream out(path, std::ios::binary);
+        out.write(reinterpret_cast<const char*>(code.data()), code.size());
+        return static_cast<bool>(out);
+    }
+
+    // Run a macro on the scheduler. Waits become timer entries and key
+    // output is batched with everything else due at the same moment.
+    // Code shared between runs is not copied. Cancelling the task releases
+    // every key the macro still holds.
+    TaskId runMacro(std::shared_ptr<const MacroCode> code) {
+        std::string error;
+        if (!code || !validateMacro(*code, &error)) {
+            std::cerr << "Refusing to run macro: " << error << std::endl;
+            return 0;
         }
-        
-        // Enable mouse button events
-        ioctl(m_uinputFd, UI_SET_KEYBIT, BTN_LEFT);
-        ioctl(m_uinputFd, UI_SET_KEYBIT, BTN_RIGHT);
-        ioctl(m_uinputFd, UI_SET_KEYBIT, BTN_MIDDLE);
-        ioctl(m_uinputFd, UI_SET_KEYBIT, BTN_SIDE);
-        ioctl(m_uinputFd, UI_SET_KEYBIT, BTN_EXTRA);
+        auto state = std::make_shared<MacroState>();
+        state->code = std::move(code);
+        auto run = [this, state](SchedClock::time_point& due, EventBatch& batch) {
+            return runMacroStep(*state, due, batch);
+        };
+        auto onStop = [this, state](EventBatch& batch) {
+            releaseMacroKeys(*state, batch);
+        };
+        return scheduleTask(SchedClock::now(), run, onStop);
+    }
 
-        // Enable mouse movement
-        ioctl(m_uinputFd, UI_SET_EVBIT, EV_REL);
-        ioctl(m_uinputFd, UI_SET_RELBIT, REL_X);
-        ioctl(m_uinputFd, UI_SET_RELBIT, REL_Y);
-        
-        // Create device
-        ioctl(m_uinputFd, UI_DEV_SETUP, &setup);
-        ioctl(m_uinputFd, UI_DEV_CREATE);
-        
-        // Start input listener thread
-        m_running = true;
-        m_listenerThread = std::thread([this]() { linuxEventLoop(); });
-        
-        m_initialized = true;
-        std::cout << "Linux input initialized" << std::endl;
-        return true;
+    TaskId runMacro(const MacroCode& code) {
+        return runMacro(std::make_shared<const MacroCode>(code));
     }
-    
-    void cleanupLinux() {
-        if (m_uinputFd >= 0) {
-            ioctl(m_uinputFd, UI_DEV_DESTROY);
-            close(m_uinputFd);
-            m_uinputFd = -1;
+
+    // Compile the macro language to bytecode. Statements end with a newline
+    // or ';', '#' starts a comment:
+    //   hold KEY | release KEY | tap KEY [xN] [every DUR]
+    //   click [BUTTON] [xN] [every DUR] | chord KEY+KEY...
+    //   wait DUR | move DX,DY [over DUR [at RATE]]
+    //   waitkey KEY [down|up] [timeout DUR]
+    //   loop [N] { ... } | if KEY [down|up] { ... } [else { ... }]
+    // Durations take us, ms or s. Adjacent key statements are folded into
+    // one prebuilt Reports instruction. Returns empty code on error.
+    static MacroCode compileMacro(std::string_view source, std::string* error = nullptr) {
+        MacroCompiler compiler(source);
+        MacroCode code;
+        if (!compiler.compileMacro(code)) {
+            if (error) *error = compiler.error();
+            return MacroCode();
         }
-        
-        for (int fd : m_inputFds) {
-            close(fd);
+        return code;
+    }
+
+    // Compile a library of `macro NAME { ... }` blocks
+    static bool compileMacroLibrary(std::string_view source,
+                                    std::unordered_map<std::string, MacroCode>& macros,
+                                    std::string* error = nullptr) {
+        MacroCompiler compiler(source);
+        if (!compiler.compileLibrary(macros)) {
+            if (error) *error = compiler.error();
+            return false;
         }
-        m_inputFds.clear();
+        return true;
     }
-    
-    void linuxEventLoop() {
-        // Open all input devices
-        DIR* dir = opendir("/dev/input");
-        if (!dir) return;
-        
-        struct dirent* ent;
-        while ((ent = readdir(dir)) != nullptr) {
-            if (strncmp(ent->d_name, "event", 5) == 0) {
-                std::string path = "/dev/input/" + std::string(ent->d_name);
-                int fd = open(path.c_str(), O_RDONLY | O_NONBLOCK);
-                if (fd >= 0) {
-                    m_inputFds.push_back(fd);
-                }
+
+    static std::unordered_map<std::string, MacroCode> loadMacroLibrary(const std::string& path) {
+        std::unordered_map<std::string, MacroCode> macros;
+        std::ifstream in(path, std::ios::binary);
+        std::string source((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        std::string error;
+        if (!in.is_open() || !compileMacroLibrary(source, macros, &error)) {
+            std::cerr << "Cannot load macros from " << path << ": "
+                      << (in.is_open() ? error : strerror(errno)) << std::endl;
+            macros.clear();
+        }
+        return macros;
+    }
+
+#ifdef INPCTRL_COROUTINES
+private:
+    struct EventBatch;
+
+public:
+    // Coroutine macro, run by spawn() on the scheduler thread:
+    //   CrossInput::CoMacro fire(CrossInput& in) {
+    //       while (true) {
+    //           co_await in.keyDown(CrossInput::Key::F5);
+    //           co_await in.press(CrossInput::Key::W);
+    //           co_await in.after(std::chrono::milliseconds(16));
+    //       }
+    //   }
+    // Suspended macros cost only their frame; there is no thread per macro.
+    class CoMacro {
+    public:
+        struct promise_type {
+            EventBatch* batch = nullptr;  // set while the scheduler resumes us
+            std::chrono::steady_clock::time_point now, due;
+            bool waitingKey = false;
+            Key waitKey = Key::A;
+            bool waitDown = true;
+            std::vector<Key> held;
+            std::exception_ptr error;
+
+            CoMacro get_return_object() {
+                return CoMacro(std::coroutine_handle<promise_type>::from_promise(*this));
             }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            std::suspend_always final_suspend() noexcept { return {}; }
+            void return_void() {}
+            void unhandled_exception() { error = std::current_exception(); }
+        };
+
+        CoMacro(CoMacro&& other) noexcept : m_handle(other.m_handle) { other.m_handle = nullptr; }
+        CoMacro& operator=(CoMacro&& other) noexcept {
+            std::swap(m_handle, other.m_handle);
+            return *this;
         }
-        closedir(dir);
-        
-        struct input_event ev;
-        while (m_running) {
-            for (int fd : m_inputFds) {
-                ssize_t n = read(fd, &ev, sizeof(ev));
-                if (n == sizeof(ev)) {
-                    // Handle keyboard events
-                    if (ev.type == EV_KEY && ev.code < 256) {
-                        unsigned int winCode = fromEvdevCode(ev.code);
-                        std::lock_guard<std::mutex> lock(m_keyMutex);
-                        m_keyStates[winCode] = (ev.value != 0);
-                    }
-                    // Handle mouse button events
-                    else if (ev.type == EV_KEY) {
-                        unsigned int winCode = 0;
-                        if (ev.code == BTN_LEFT) winCode = 0x01;       // LMB
-                        else if (ev.code == BTN_RIGHT) winCode = 0x02; // RMB
-                        else if (ev.code == BTN_MIDDLE) winCode = 0x04; // MMB
-                        else if (ev.code == BTN_SIDE) winCode = 0x05;   // Mouse4
-                        else if (ev.code == BTN_EXTRA) winCode = 0x06;  // Mouse5
-                        
-                        if (winCode != 0) {
-                            std::lock_guard<std::mutex> lock(m_keyMutex);
-                            m_keyStates[winCode] = (ev.value != 0);
-                        }
-                    }
+        CoMacro(const CoMacro&) = delete;
+        CoMacro& operator=(const CoMacro&) = delete;
+        ~CoMacro() {
+            if (m_handle) m_handle.destroy();
+        }
+
+    private:
+        friend class CrossInput;
+        explicit CoMacro(std::coroutine_handle<promise_type> handle) : m_handle(handle) {}
+        std::coroutine_handle<promise_type> m_handle;
+    };
+
+    // Cancels every macro spawned with it at once. Held keys are released.
+    // Cancel before the CrossInput that ran the macros is destroyed.
+    class CancelToken {
+    public:
+        CancelToken() : m_state(std::make_shared<State>()) {}
+
+        void cancel() {
+            std::vector<std::function<void()>> callbacks;
+            {
+                std::lock_guard<std::mutex> lock(m_state->mutex);
+                if (m_state->cancelled) return;
+                m_state->cancelled = true;
+                callbacks.swap(m_state->callbacks);
+            }
+            for (auto& callback : callbacks) callback();
+        }
+
+        bool cancelled() const {
+            std::lock_guard<std::mutex> lock(m_state->mutex);
+            return m_state->cancelled;
+        }
+
+    private:
+        friend class CrossInput;
+        struct State {
+            mutable std::mutex mutex;
+            bool cancelled = false;
+            std::vector<std::function<void()>> callbacks;
+        };
+        std::shared_ptr<State> m_state;
+
+        // Runs `callback` on cancel(), or right away if already cancelled
+        void onCancel(std::function<void()> callback) {
+            {
+                std::lock_guard<std::mutex> lock(m_state->mutex);
+                if (!m_state->cancelled) {
+                    m_state->callbacks.push_back(std::move(callback));
+                    return;
                 }
             }
-            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            callback();
         }
-    }
-    
-    void emitEvent(int type, int code, int val) {
-        if (m_uinputFd < 0) return;
-        
-        struct input_event ie;
-        memset(&ie, 0, sizeof(ie));
-        ie.type = type;
-        ie.code = code;
-        ie.value = val;
-        write(m_uinputFd, &ie, sizeof(ie));
+    };
+
+    // Suspends until the deadline. Deadlines follow on from the previous
+    // one, so a loop of after(16ms) keeps its cadence.
+    struct AfterAwaiter {
+        std::chrono::steady_clock::duration delay;
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<CoMacro::promise_type> handle) const {
+            auto& promise = handle.promise();
+            promise.due = promise.now + delay;
+        }
+        void await_resume() const noexcept {}
+    };
+
+    // Suspends until the key is down (or up); no wait if it already is
+    struct KeyAwaiter {
+        CrossInput* input;
+        Key key;
+        bool down;
+        bool await_ready() const { return input->isKeyPressed(key) == down; }
+        void await_suspend(std::coroutine_handle<CoMacro::promise_type> handle) const {
+            auto& promise = handle.promise();
+            promise.waitingKey = true;
+            promise.waitKey = key;
+            promise.waitDown = down;
+        }
+        void await_resume() const noexcept {}
+    };
+
+    // Queues output into the scheduler's batch without suspending
+    struct OutputAwaiter {
+        CrossInput* input;
+        Key key;
+        int action;  // 0 = release, 1 = hold, 2 = tap
+        bool await_ready() const noexcept { return false; }
+        bool await_suspend(std::coroutine_handle<CoMacro::promise_type> handle) const {
+            auto& promise = handle.promise();
+            if (promise.batch) input->queueCoKey(promise, key, action);
+            return false;
+        }
+        void await_resume() const noexcept {}
+    };
+
+    AfterAwaiter after(std::chrono::steady_clock::duration delay) { return AfterAwaiter{delay}; }
+    KeyAwaiter keyDown(Key key) { return KeyAwaiter{this, key, true}; }
+    KeyAwaiter keyUp(Key key) { return KeyAwaiter{this, key, false}; }
+    OutputAwaiter press(Key key) { return OutputAwaiter{this, key, 2}; }
+    OutputAwaiter hold(Key key) { return OutputAwaiter{this, key, 1}; }
+    OutputAwaiter release(Key key) { return OutputAwaiter{this, key, 0}; }
+
+    // Start a coroutine macro on the scheduler. It stops when it returns,
+    // on cancelTask(), or when `token` is cancelled.
+    TaskId spawn(CoMacro macro, CancelToken token = CancelToken()) {
+        if (!macro.m_handle) return 0;
+        auto frame = std::make_shared<CoMacro>(std::move(macro));
         
-        // Sync event
-        memset(&ie, 0, sizeof(ie));
-        ie.type = EV_SYN;
-        ie.code = SYN_REPORT;
-        ie.value = 0;
-        write(m_uinputFd, &ie, sizeof(ie));
+        auto run = [this, frame](SchedClock::time_point& due, EventBatch& batch) {
+            auto& promise = frame->m_handle.promise();
+            if (promise.waitingKey && !resumedByKey()) {
+                // Only a polled mouse button (Windows) gets here early
+                due = kTaskParked;
+                if (!awaitKey(promise.waitKey, promise.waitDown, due)) return true;
+            }
+            promise.waitingKey = false;
+            
+            promise.now = catchUp(due, SchedClock::now());
+            promise.due = promise.now;
+            promise.batch = &batch;
+            frame->m_handle.resume();
+            promise.batch = nullptr;
+            endReport(batch);
+            
+            if (frame->m_handle.done()) {
+                if (promise.error) std::cerr << "Coroutine macro ended with an exception" << std::endl;
+                releaseCoKeys(promise, batch);
+                return false;
+            }
+            due = promise.due;
+            if (promise.waitingKey) {
+                // Parked until the listener sees the edge
+                due = kTaskParked;
+                if (awaitKey(promise.waitKey, promise.waitDown, due)) {
+                    promise.waitingKey = false;
+                    due = SchedClock::now();
+                }
+            }
+            return true;
+        };
+        auto onStop = [this, frame](EventBatch& batch) {
+            releaseCoKeys(frame->m_handle.promise(), batch);
+        };
+        TaskId id = scheduleTask(SchedClock::now(), run, onStop);
+        token.onCancel([this, id]() { cancelTask(id); });
+        return id;
     }
-    
-    void holdKeyLinux(unsigned int evdevCode) {
-        emitEvent(EV_KEY, evdevCode, 1);
+#endif
+
+    // Put the pointer at (x, y) in desktop coordinates with a single report
+    bool moveMouseTo(int x, int y) {
+#ifdef _WIN32
+        return moveMouseToWindows(x, y);
+#else
+        return moveMouseToLinux(x, y);
+#endif
     }
-    
-    void releaseKeyLinux(unsigned int evdevCode) {
-        emitEvent(EV_KEY, evdevCode, 0);
+
+    // Put the pointer at (x, y) relative to the top-left corner of a monitor
+    bool moveMouseTo(int monitor, int x, int y) {
+        if (monitor < 0 || monitor >= static_cast<int>(m_options.monitors.size())) {
+            std::cerr << "Monitor " << monitor << " is not configured" << std::endl;
+            return false;
+        }
+        const Monitor& m = m_options.monitors[monitor];
+        return moveMouseTo(m.x + x, m.y + y);
     }
-    
-    void moveMouseLinux(int dx, int dy) {
-        emitEvent(EV_REL, REL_X, dx);
-        emitEvent(EV_REL, REL_Y, dy);
+
+    // Scroll by `dy` notches vertically (positive = up) and `dx` notches
+    // horizontally (positive = right). Fractions of a notch are sent as
+    // high-resolution wheel units (1/120 notch).
+    void scroll(double dy, double dx = 0.0) {
+        EventBatch batch;
+        queueScroll(batch, static_cast<int>(std::lround(dy * 120)),
+                    static_cast<int>(std::lround(dx * 120)));
+        endReport(batch);
+        emitBatch(batch);
     }
 
-    void typeCharLinux(char c, int delayMs) {
-        // Map of common ASCII characters to their Linux key codes and shift requirements
-        struct KeyMapping {
-            unsigned int keyCode;
-            bool needShift;
+    // Scroll smoothly over `durationMs`, streaming high-resolution wheel
+    // ticks at `rateHz` on the scheduler. Ticks share reports with any
+    // pointer motion due at the same moment.
+    TaskId smoothScroll(double dy, double dx, int durationMs, int rateHz = 250,
+                        PathCurve curve = PathCurve::EaseOut) {
+        rateHz = std::max(1, std::min(rateHz, 1000));
+        struct ScrollState {
+            int samples;
+            int sample = 0;
+            long sentV = 0, sentH = 0;
         };
+        auto state = std::make_shared<ScrollState>();
+        state->samples = std::max(1, static_cast<int>(static_cast<long long>(durationMs) * rateHz / 1000));
+        long totalV = std::lround(dy * 120);
+        long totalH = std::lround(dx * 120);
+        auto period = std::chrono::duration_cast<SchedClock::duration>(
+            std::chrono::duration<double>(1.0 / rateHz));
         
-        static std::unordered_map<char, KeyMapping> charMap = {
-            // Lowercase letters
-            {'a', {KEY_A, false}}, {'b', {KEY_B, false}}, {'c', {KEY_C, false}},
-            {'d', {KEY_D, false}}, {'e', {KEY_E, false}}, {'f', {KEY_F, false}},
-            {'g', {KEY_G, false}}, {'h', {KEY_H, false}}, {'i', {KEY_I, false}},
-            {'j', {KEY_J, false}}, {'k', {KEY_K, false}}, {'l', {KEY_L, false}},
-            {'m', {KEY_M, false}}, {'n', {KEY_N, false}}, {'o', {KEY_O, false}},
-            {'p', {KEY_P, false}}, {'q', {KEY_Q, false}}, {'r', {KEY_R, false}},
+        auto run = [this, totalV, totalH, curve, state, period]
+                   (SchedClock::time_point& due, EventBatch& batch) {
+            state->sample++;
+            double t = applyCurve(curve, static_cast<double>(state->sample) / state->samples);
+            long v = (state->sample >= state->samples) ? totalV : std::lround(totalV * t);
+            long h = (state->sample >= state->samples) ? totalH : std::lround(totalH * t);
+            if (v != state->sentV || h != state->sentH) {
+                queueScroll(batch, static_cast<int>(v - state->sentV), static_cast<int>(h - state->sentH));
+                state->sentV = v;
+                state->sentH = h;
+            }
+            due += period;
+            return state->sample < state->samples;
+        };
+        return scheduleTask(SchedClock::now() + period, run);
+    }
+
+    // Move the mouse by (dx, dy) over `durationMs`, streaming one combined
+    // X/Y report per sample at `rateHz` (up to 1000) on the scheduler.
+    // Fractional pixels are carried between samples so the total is exact.
+    TaskId moveMousePath(int dx, int dy, int durationMs,
+                         PathCurve curve = PathCurve::Linear, int rateHz = 1000) {
+        return startMousePath(dx, dy, durationMs, curve, rateHz,
+                              [dx, dy](double t, double& x, double& y) {
+                                  x = dx * t;
+                                  y = dy * t;
+                              });
+    }
+
+    // Same as moveMousePath() but following a cubic Bezier curve from the
+    // current position to (dx, dy) with control points relative to the start
+    TaskId moveMousePath(int dx, int dy, int durationMs,
+                         double ctrl1x, double ctrl1y, double ctrl2x, double ctrl2y,
+                         PathCurve curve = PathCurve::Linear, int rateHz = 1000) {
+        return startMousePath(dx, dy, durationMs, curve, rateHz,
+                              [=](double t, double& x, double& y) {
+                                  double u = 1.0 - t;
+                                  double b1 = 3 * u * u * t, b2 = 3 * u * t * t, b3 = t * t * t;
+                                  x = b1 * ctrl1x + b2 * ctrl2x + b3 * dx;
+                                  y = b1 * ctrl1y + b2 * ctrl2y + b3 * dy;
+                              });
+    }
+
+    // Type a string of text
+    void typeText(const std::string& text, int delayBetweenKeys = 30) {
+#ifndef _WIN32
+        // Without a delay the whole string goes out in a single write
+        if (delayBetweenKeys <= 0) {
+            EventBatch batch;
+            appendTextLinux(batch, text);
+            emitBatch(batch);
+            return;
+        }
+#endif
+        for (char c : text) {
+            typeChar(c, delayBetweenKeys);
+        }
+    }
+
+    // Move mouse relative to current position
+    void moveMouse(int dx, int dy) {
+#ifdef _WIN32
+        moveMouseWindows(dx, dy);
+#else
+        moveMouseLinux(dx, dy);
+#endif
+    }
+
+    // Get human-readable key name
+    std::string getKeyName(Key key) {
+        unsigned int code = static_cast<unsigned int>(key);
+        
+        static std::unordered_map<unsigned int, std::string> names = {
+            {0x41, "A"}, {0x42, "B"}, {0x43, "C"}, {0x44, "D"}, {0x45, "E"},
+            {0x46, "F"}, {0x47, "G"}, {0x48, "H"}, {0x49, "I"}, {0x4A, "J"},
+            {0x4B, "K"}, {0x4C, "L"}, {0x4D, "M"}, {0x4E, "N"}, {0x4F, "O"},
+            {0x50, "P"}, {0x51, "Q"}, {0x52, "R"}, {0x53, "S"}, {0x54, "T"},
+            {0x55, "U"}, {0x56, "V"}, {0x57, "W"}, {0x58, "X"}, {0x59, "Y"},
+            {0x5A, "Z"}, 
+            {0x30, "0"}, {0x31, "1"}, {0x32, "2"}, {0x33, "3"}, {0x34, "4"},
+            {0x35, "5"}, {0x36, "6"}, {0x37, "7"}, {0x38, "8"}, {0x39, "9"},
+            {0x20, "Space"}, {0x0D, "Enter"}, {0x09, "Tab"},
+            {0x1B, "Escape"}, {0x08, "Backspace"}, {0x2E, "Delete"}, {0x2D, "Insert"},
+            {0x70, "F1"}, {0x71, "F2"}, {0x72, "F3"},
+            {0x73, "F4"}, {0x74, "F5"}, {0x75, "F6"}, {0x76, "F7"},
+            {0x77, "F8"}, {0x78, "F9"}, {0x79, "F10"}, {0x7A, "F11"},
+            {0x7B, "F12"}, 
+            {0xDB, "["}, {0xDD, "]"}, 
+            {0xBF, "/"}, {0xBA, ";"}, 
+            {0xBD, "-"}, {0xBB, "="}, {0xDC, "\\"}, 
+            {0xDE, "'"}, {0xBC, ","}, {0xBE, "."}, {0xC0, "`"},
+            {0x25, "Left"}, {0x26, "Up"}, {0x27, "Right"}, {0x28, "Down"},
+            {0xA0, "LShift"}, {0xA1, "RShift"}, 
+            {0xA2, "LCtrl"}, {0xA3, "RCtrl"},
+            {0xA4, "LAlt"}, {0xA5, "RAlt"},
+            // Mouse buttons
+            {0x01, "LMB"}, {0x02, "RMB"}, {0x04, "MMB"},
+            {0x05, "Mouse4"}, {0x06, "Mouse5"}, // Navigation keys
+            {0x24, "Home"}, {0x23, "End"}, {0x21, "PageUp"}, {0x22, "PageDown"},
+            // Numpad
+            {0x60, "Numpad0"}, {0x61, "Numpad1"}, {0x62, "Numpad2"}, {0x63, "Numpad3"},
+            {0x64, "Numpad4"}, {0x65, "Numpad5"}, {0x66, "Numpad6"}, {0x67, "Numpad7"},
+            {0x68, "Numpad8"}, {0x69, "Numpad9"},
+            {0x6A, "Numpad*"}, {0x6B, "Numpad+"}, {0x6D, "Numpad-"},
+            {0x6E, "Numpad."}, {0x6F, "Numpad/"},
+            // Lock keys
+            {0x14, "CapsLock"}, {0x90, "NumLock"}, {0x91, "ScrollLock"},
+            // System keys
+            {0x2C, "PrintScreen"}, {0x13, "Pause"},
+            // Windows key
+            {0x5B, "LWin"}, {0x5C, "RWin"},
+        };
+        
+        if (names.count(code)) {
+            return names[code];
+        }
+        return "Unknown";
+    }
+
+    //A function that gets the current pressed key.
+    Key getCurrentPressedKey(int timeout_ms = 0) {
+#ifdef _WIN32
+        return getCurrentPressedKeyWindows(timeout_ms);
+#else
+        return getCurrentPressedKeyLinux(timeout_ms);
+#endif
+    }
+
+#ifndef _WIN32
+    // Register a hotstring: once `trigger` has been typed on a physical
+    // keyboard it is erased with Backspace (if eraseTrigger) and
+    // `replacement` is typed in its place. Returns an id, or -1 if the
+    // trigger contains characters that cannot be typed.
+    int addHotstring(const std::string& trigger, const std::string& replacement,
+                     bool eraseTrigger = true) {
+        Hotstring hs;
+        hs.trigger = trigger;
+        hs.replacement = replacement;
+        hs.erase = eraseTrigger;
+        return registerHotstring(std::move(hs));
+    }
+
+    // Register a hotstring that runs a callback instead of typing text.
+    // The callback runs on the listener thread and should return quickly.
+    int addHotstring(const std::string& trigger, std::function<void()> callback) {
+        Hotstring hs;
+        hs.trigger = trigger;
+        hs.erase = false;
+        hs.callback = std::move(callback);
+        return registerHotstring(std::move(hs));
+    }
+
+    bool removeHotstring(int id) {
+        std::lock_guard<std::mutex> lock(m_hotstringMutex);
+        for (auto it = m_hotstrings.begin(); it != m_hotstrings.end(); ++it) {
+            if (it->id == id) {
+                m_hotstrings.erase(it);
+                m_hotstringAutomaton = std::make_shared<HotstringAutomaton>(m_hotstrings);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void clearHotstrings() {
+        std::lock_guard<std::mutex> lock(m_hotstringMutex);
+        m_hotstrings.clear();
+        m_hotstringAutomaton.reset();
+    }
+
+    // Add a reflex rule evaluated by the listener as soon as `trigger`
+    // changes state, e.g. addRule(Key::Mouse4, KeyEdge::Down,
+    // {{RuleOp::Hold, Key::LShift}}). The actions of every rule matched in
+    // one listener pass go out in a single uinput write. Returns a rule id.
+    int addRule(Key trigger, KeyEdge edge, const std::vector<RuleAction>& actions) {
+        KeyRule rule;
+        rule.trigger = static_cast<unsigned int>(trigger);
+        rule.edge = edge;
+        for (const RuleAction& action : actions) {
+            unsigned int code = toEvdevCode(static_cast<unsigned int>(action.key));
+            if (action.op != RuleOp::Release) rule.output.push_back({code, 1});
+            if (action.op != RuleOp::Hold) rule.output.push_back({code, 0});
+        }
+        return registerRule(std::move(rule));
+    }
+
+    // Subscribe to state changes of a key. The callback runs on the listener
+    // thread with the key and its new state and should return quickly.
+    int subscribeKey(Key key, std::function<void(Key, bool)> callback,
+                     KeyEdge edge = KeyEdge::Both) {
+        KeyRule rule;
+        rule.trigger = static_cast<unsigned int>(key);
+        rule.edge = edge;
+        rule.callback = std::move(callback);
+        return registerRule(std::move(rule));
+    }
+
+    // Remove a rule or subscription by id
+    bool removeRule(int id) {
+        std::lock_guard<std::mutex> lock(m_ruleMutex);
+        for (auto it = m_rules.begin(); it != m_rules.end(); ++it) {
+            if (it->id == id) {
+                m_rules.erase(it);
+                rebuildRuleTable();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Subscribe to physical mouse motion. The callback runs on the listener
+    // thread once per device report that carried motion or wheel events.
+    int subscribeMouseMotion(std::function<void(const MouseDelta&)> callback) {
+        std::lock_guard<std::mutex> lock(m_ruleMutex);
+        auto subscribers = std::make_shared<MotionSubscribers>(
+            m_motionSubscribers ? *m_motionSubscribers : MotionSubscribers());
+        int id = m_nextRuleId++;
+        subscribers->push_back({id, std::move(callback)});
+        m_motionSubscribers = subscribers;
+        return id;
+    }
+
+    // Remove a key or mouse motion subscription
+    bool unsubscribe(int id) {
+        if (removeRule(id)) return true;
+        
+        std::lock_guard<std::mutex> lock(m_ruleMutex);
+        if (!m_motionSubscribers) return false;
+        auto subscribers = std::make_shared<MotionSubscribers>();
+        for (const auto& sub : *m_motionSubscribers) {
+            if (sub.first != id) subscribers->push_back(sub);
+        }
+        bool removed = subscribers->size() != m_motionSubscribers->size();
+        m_motionSubscribers = subscribers->empty() ? nullptr : subscribers;
+        return removed;
+    }
+
+    // Remove every rule and every key or mouse motion subscription
+    void clearRules() {
+        std::lock_guard<std::mutex> lock(m_ruleMutex);
+        m_rules.clear();
+        rebuildRuleTable();
+        m_motionSubscribers.reset();
+    }
+
+    // Physical mouse motion accumulated since the previous call. Reading
+    // resets the totals, so each movement is reported exactly once.
+    MouseDelta consumeMouseDelta() {
+        MouseDelta delta;
+        delta.dx = m_mouseMotion[0].exchange(0, std::memory_order_relaxed);
+        delta.dy = m_mouseMotion[1].exchange(0, std::memory_order_relaxed);
+        delta.wheel = m_mouseMotion[2].exchange(0, std::memory_order_relaxed);
+        delta.hwheel = m_mouseMotion[3].exchange(0, std::memory_order_relaxed);
+        return delta;
+    }
+
+    // Latency from the kernel timestamp of a trigger event to the end of the
+    // uinput write carrying its rule actions
+    LatencyHistogram getRuleLatency() const {
+        return m_ruleLatency.snapshot();
+    }
+
+    void resetRuleLatency() {
+        m_ruleLatency.reset();
+    }
+
+    // Enable the debounce stage for all keys and buttons of physical devices.
+    // It runs before key state, rules, subscriptions, hotstrings and the remap
+    // pipeline, using the kernel event timestamps.
+    void setDebounce(DebounceMode mode, unsigned int thresholdUs = 5000) {
+        std::lock_guard<std::mutex> lock(m_debounceMutex);
+        auto config = std::make_shared<DebounceConfig>();
+        config->mode = mode;
+        for (auto& t : config->thresholdUs) t = thresholdUs;
+        m_debounceConfig = (mode == DebounceMode::Off) ? nullptr : config;
+    }
+
+    // Override the threshold of one key (0 disables debouncing for it).
+    // Call after setDebounce().
+    void setKeyDebounce(Key key, unsigned int thresholdUs) {
+        std::lock_guard<std::mutex> lock(m_debounceMutex);
+        if (!m_debounceConfig) return;
+        auto config = std::make_shared<DebounceConfig>(*m_debounceConfig);
+        unsigned int code = toEvdevCode(static_cast<unsigned int>(key));
+        if (code < KEY_CNT) config->thresholdUs[code] = thresholdUs;
+        m_debounceConfig = config;
+    }
+
+    // Number of suppressed bounces seen on a key since the last reset
+    uint32_t getBounceCount(Key key) const {
+        unsigned int code = toEvdevCode(static_cast<unsigned int>(key));
+        return code < KEY_CNT ? m_bounceCounts[code].load(std::memory_order_relaxed) : 0;
+    }
+
+    // Every key with at least one suppressed bounce
+    std::vector<std::pair<Key, uint32_t>> getBounceCounts() const {
+        std::vector<std::pair<Key, uint32_t>> counts;
+        for (unsigned int code = 0; code < KEY_CNT; ++code) {
+            uint32_t n = m_bounceCounts[code].load(std::memory_order_relaxed);
+            unsigned int winCode = keyCodeFromEvdev(code);
+            if (n && winCode) counts.push_back({static_cast<Key>(winCode), n});
+        }
+        return counts;
+    }
+
+    void resetBounceCounts() {
+        for (auto& n : m_bounceCounts) n = 0;
+    }
+
+    // A remap stage rewrites a batch of events in place and returns the new
+    // event count (stages may drop events but never add them)
+    using RemapStage = std::function<size_t(struct input_event* events, size_t count)>;
+
+    struct RemapStageTiming {
+        std::string name;
+        LatencyHistogram timing;
+    };
+
+    // Grab (EVIOCGRAB) every physical device whose name contains `nameFilter`
+    // so its events only reach the system after passing through the remap
+    // stages and being re-emitted on the virtual device
+    bool grabDevices(const std::string& nameFilter) {
+        if (m_uinputFd < 0) {
+            std::cerr << "Cannot grab devices without a uinput device to re-emit on" << std::endl;
+            return false;
+        }
+        bool any = false;
+        std::lock_guard<std::mutex> lock(m_remapMutex);
+        for (InputDevice& dev : m_inputDevices) {
+            if (dev.isVirtual || dev.grabbed) continue;
+            if (dev.name.find(nameFilter) == std::string::npos) continue;
+            // Whatever uinput cannot re-emit would be lost without a trace
+            std::string missing = missingCaps(dev.fd);
+            if (!missing.empty()) {
+                std::cerr << "Not grabbing " << dev.name << ": the virtual device cannot re-emit its "
+                          << missing << std::endl;
+                continue;
+            }
+            if (ioctl(dev.fd, EVIOCGRAB, 1) < 0) {
+                std::cerr << "Failed to grab " << dev.name << ": " << strerror(errno) << std::endl;
+                continue;
+            }
+            dev.grabbed = true;
+            any = true;
+        }
+        return any;
+    }
+
+    void releaseDevices() {
+        std::lock_guard<std::mutex> lock(m_remapMutex);
+        for (InputDevice& dev : m_inputDevices) {
+            if (!dev.grabbed) continue;
+            ioctl(dev.fd, EVIOCGRAB, 0);
+            dev.grabbed = false;
+        }
+    }
+
+    // Append a stage to the remap pipeline run on grabbed devices
+    int addRemapStage(const std::string& name, RemapStage stage) {
+        auto entry = std::make_shared<RemapStageEntry>();
+        entry->name = name;
+        entry->stage = std::move(stage);
+
+        std::lock_guard<std::mutex> lock(m_remapMutex);
+        entry->id = m_nextRemapStageId++;
+        auto pipeline = std::make_shared<RemapPipeline>(m_remapPipeline ? *m_remapPipeline : RemapPipeline());
+        pipeline->push_back(entry);
+        m_remapPipeline = pipeline;
+        return entry->id;
+    }
+
+    bool removeRemapStage(int id) {
+        std::lock_guard<std::mutex> lock(m_remapMutex);
+        if (!m_remapPipeline) return false;
+        auto pipeline = std::make_shared<RemapPipeline>();
+        for (const auto& entry : *m_remapPipeline) {
+            if (entry->id != id) pipeline->push_back(entry);
+        }
+        bool removed = pipeline->size() != m_remapPipeline->size();
+        m_remapPipeline = pipeline;
+        return removed;
+    }
+
+    void clearRemapStages() {
+        std::lock_guard<std::mutex> lock(m_remapMutex);
+        m_remapPipeline.reset();
+    }
+
+    // Time spent in each stage per batch
+    std::vector<RemapStageTiming> getRemapTimings() {
+        std::shared_ptr<const RemapPipeline> pipeline;
+        {
+            std::lock_guard<std::mutex> lock(m_remapMutex);
+            pipeline = m_remapPipeline;
+        }
+        std::vector<RemapStageTiming> timings;
+        if (!pipeline) return timings;
+        for (const auto& entry : *pipeline) {
+            timings.push_back({entry->name, entry->timing.snapshot()});
+        }
+        return timings;
+    }
+
+    // Passthrough latency of grabbed devices, from the kernel timestamp of
+    // the last event in a batch to the end of the re-emitting write
+    LatencyHistogram getRemapLatency() const {
+        return m_remapLatency.snapshot();
+    }
+
+    void resetRemapLatency() {
+        m_remapLatency.reset();
+        std::lock_guard<std::mutex> lock(m_remapMutex);
+        if (!m_remapPipeline) return;
+        for (const auto& entry : *m_remapPipeline) entry->timing.reset();
+    }
+
+    // Stage mapping keys one to one
+    static RemapStage remapKeys(const std::vector<std::pair<Key, Key>>& mapping) {
+        auto table = std::make_shared<std::vector<uint16_t>>(KEY_CNT);
+        for (unsigned int i = 0; i < KEY_CNT; ++i) (*table)[i] = i;
+        for (const auto& m : mapping) {
+            (*table)[toEvdevCode(static_cast<unsigned int>(m.first))] =
+                toEvdevCode(static_cast<unsigned int>(m.second));
+        }
+        return [table](struct input_event* events, size_t count) {
+            for (size_t i = 0; i < count; ++i) {
+                if (events[i].type == EV_KEY && events[i].code < KEY_CNT) {
+                    events[i].code = (*table)[events[i].code];
+                }
+            }
+            return count;
+        };
+    }
+
+    // Stage exchanging two keys
+    static RemapStage swapKeys(Key a, Key b) {
+        return remapKeys({{a, b}, {b, a}});
+    }
+
+    // Stage removing every event of the given keys
+    static RemapStage dropKeys(const std::vector<Key>& keys) {
+        auto dropped = std::make_shared<std::vector<bool>>(KEY_CNT, false);
+        for (Key key : keys) (*dropped)[toEvdevCode(static_cast<unsigned int>(key))] = true;
+        return [dropped](struct input_event* events, size_t count) {
+            size_t kept = 0;
+            for (size_t i = 0; i < count; ++i) {
+                if (events[i].type == EV_KEY && events[i].code < KEY_CNT && (*dropped)[events[i].code]) {
+                    continue;
+                }
+                events[kept++] = events[i];
+            }
+            return kept;
+        };
+    }
+
+    // Stage applying `mapping` while `layerKey` is held. The layer key itself
+    // is consumed, and a key keeps its layer mapping until it is released.
+    static RemapStage layer(Key layerKey, const std::vector<std::pair<Key, Key>>& mapping) {
+        struct LayerState {
+            uint16_t layerCode;
+            bool active = false;
+            std::vector<uint16_t> table;
+            std::vector<uint16_t> pressedAs;  // output code of each held input key
+        };
+        auto state = std::make_shared<LayerState>();
+        state->layerCode = toEvdevCode(static_cast<unsigned int>(layerKey));
+        state->table.resize(KEY_CNT);
+        state->pressedAs.resize(KEY_CNT);
+        for (unsigned int i = 0; i < KEY_CNT; ++i) state->table[i] = state->pressedAs[i] = i;
+        for (const auto& m : mapping) {
+            state->table[toEvdevCode(static_cast<unsigned int>(m.first))] =
+                toEvdevCode(static_cast<unsigned int>(m.second));
+        }
+        return [state](struct input_event* events, size_t count) {
+            size_t kept = 0;
+            for (size_t i = 0; i < count; ++i) {
+                struct input_event& ev = events[i];
+                if (ev.type == EV_KEY && ev.code < KEY_CNT) {
+                    if (ev.code == state->layerCode) {
+                        state->active = (ev.value != 0);
+                        continue;
+                    }
+                    if (ev.value == 1) {
+                        state->pressedAs[ev.code] = state->active ? state->table[ev.code] : ev.code;
+                    }
+                    ev.code = state->pressedAs[ev.code];
+                }
+                events[kept++] = ev;
+            }
+            return kept;
+        };
+    }
+
+    // Event classes captured by startRecording()
+    enum RecordFilter : unsigned int {
+        RecordKeys    = 1u << 0,
+        RecordButtons = 1u << 1,
+        RecordMotion  = 1u << 2,
+        RecordWheel   = 1u << 3,
+        RecordAll     = 0xFu,
+    };
+
+    // One recorded event as stored on disk (16 bytes)
+    struct RecordedEvent {
+        uint64_t timeNs;  // CLOCK_MONOTONIC kernel timestamp
+        uint16_t type;
+        uint16_t code;
+        int32_t value;
+    };
+
+    struct RecordingStats {
+        uint64_t events = 0;
+        uint64_t dropped = 0;  // ring overflows, should stay 0
+        uint64_t bytes = 0;
+    };
+
+    // Start capturing physical input into `path`. The listener hands events
+    // to a writer thread through a lock-free ring; the writer appends them
+    // to a memory-mapped file that grows in large chunks.
+    bool startRecording(const std::string& path, unsigned int filter = RecordAll) {
+        std::lock_guard<std::mutex> lock(m_recordMutex);
+        if (m_recorder) {
+            std::cerr << "A recording is already running" << std::endl;
+            return false;
+        }
+        
+        auto recorder = std::make_shared<Recorder>();
+        recorder->filter = filter;
+        recorder->fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (recorder->fd < 0) {
+            std::cerr << "Failed to create " << path << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+        if (!growRecording(*recorder, kRecordChunkBytes)) {
+            close(recorder->fd);
+            return false;
+        }
+        
+        RecordingHeader* header = reinterpret_cast<RecordingHeader*>(recorder->map);
+        memcpy(header->magic, kRecordingMagic, sizeof(header->magic));
+        header->version = 1;
+        header->recordSize = sizeof(RecordedEvent);
+        header->startNs = monotonicNowNs();
+        
+        Recorder* raw = recorder.get();
+        recorder->writer = std::thread([this, raw]() { recordingWriterLoop(*raw); });
+        configureThread(recorder->writer, "inpctrl-record");
+        m_recorder = recorder;
+        m_liveRecorder = raw;
+        return true;
+    }
+
+    // Stop capturing, flush everything still in the ring and close the file
+    RecordingStats stopRecording() {
+        std::shared_ptr<Recorder> recorder;
+        {
+            std::lock_guard<std::mutex> lock(m_recordMutex);
+            recorder.swap(m_recorder);
+            m_liveRecorder = nullptr;
+        }
+        if (!recorder) return RecordingStats();
+        // Both sides use seq_cst, so once the flag reads false the listener
+        // either is done with the recorder or will see it gone
+        while (m_recorderInUse.load()) std::this_thread::yield();
+        
+        recorder->stopping = true;
+        if (recorder->writer.joinable()) recorder->writer.join();
+        
+        RecordingStats stats = recordingStats(*recorder);
+        finishRecording(*recorder);
+        return stats;
+    }
+
+    bool isRecording() {
+        std::lock_guard<std::mutex> lock(m_recordMutex);
+        return m_recorder != nullptr;
+    }
+
+    RecordingStats getRecordingStats() {
+        std::lock_guard<std::mutex> lock(m_recordMutex);
+        return m_recorder ? recordingStats(*m_recorder) : RecordingStats();
+    }
+
+    // Read every event of a recording file (raw or compact). Files left
+    // behind by a crashed process are read up to the last complete record.
+    static std::vector<RecordedEvent> loadRecording(const std::string& path) {
+        std::vector<RecordedEvent> events;
+        RecordingReader reader(path);
+        if (!reader.isOpen()) return events;
+        events.reserve(reader.size());
+        RecordedEvent ev;
+        while (reader.next(ev)) events.push_back(ev);
+        return events;
+    }
+
+private:
+    // Compact format (version 2), see RecordingWriter
+    static constexpr char kCompactMagic[8] = {'I', 'N', 'P', 'C', 'R', 'E', 'C', '2'};
+
+    struct CompactHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t blockEvents;
+        uint64_t eventCount;
+        uint64_t startNs;
+        uint64_t endNs;
+        uint64_t dictOffset;   // uint32 count, then count x (type << 16 | code)
+        uint64_t indexOffset;  // indexCount x CompactIndexEntry
+        uint64_t indexCount;
+    };
+
+    struct CompactIndexEntry {
+        uint64_t timeNs;      // first event of the block
+        uint64_t offset;      // file offset of the block
+        uint64_t firstEvent;  // event number of the block's first event
+    };
+
+public:
+    // Writes the compact recording format (version 2): events are grouped
+    // in blocks, each event stored as a zig-zag varint timestamp delta in
+    // microseconds, a varint index into a (type, code) dictionary and a
+    // zig-zag varint value. A sparse index of block start times follows the
+    // blocks so readers can seek without decoding.
+    class RecordingWriter {
+    public:
+        explicit RecordingWriter(const std::string& path, uint32_t blockEvents = 4096)
+            : m_blockEvents(blockEvents ? blockEvents : 4096) {
+            m_fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (m_fd < 0) {
+                std::cerr << "Failed to create " << path << ": " << strerror(errno) << std::endl;
+                return;
+            }
+            CompactHeader header;
+            memset(&header, 0, sizeof(header));
+            m_ok = writeAll(&header, sizeof(header));
+            m_offset = sizeof(header);
+        }
+
+        ~RecordingWriter() {
+            finish();
+        }
+
+        RecordingWriter(const RecordingWriter&) = delete;
+        RecordingWriter& operator=(const RecordingWriter&) = delete;
+
+        bool isOpen() const { return m_fd >= 0 && m_ok; }
+
+        bool add(const RecordedEvent& ev) {
+            if (!isOpen()) return false;
+            uint64_t us = ev.timeNs / 1000;
+            if (m_count % m_blockEvents == 0) {
+                flushBuffer();
+                m_index.push_back({us * 1000, m_offset, m_count});
+                m_prevUs = us;
+            }
+            if (m_count == 0) m_startNs = us * 1000;
+            m_endNs = us * 1000;
+            
+            uint32_t key = (static_cast<uint32_t>(ev.type) << 16) | ev.code;
+            auto it = m_dictLookup.find(key);
+            uint32_t symbol;
+            if (it == m_dictLookup.end()) {
+                symbol = static_cast<uint32_t>(m_dict.size());
+                m_dictLookup[key] = symbol;
+                m_dict.push_back(key);
+            } else {
+                symbol = it->second;
+            }
+            
+            putVarint(m_buffer, zigzag(static_cast<int64_t>(us - m_prevUs)));
+            putVarint(m_buffer, symbol);
+            putVarint(m_buffer, zigzag(ev.value));
+            m_prevUs = us;
+            m_count++;
+            if (m_buffer.size() >= 64 * 1024) flushBuffer();
+            return m_ok;
+        }
+
+        // Write the dictionary, index and header. Called by the destructor.
+        bool finish() {
+            if (m_fd < 0) return m_ok;
+            flushBuffer();
+            
+            CompactHeader header;
+            memset(&header, 0, sizeof(header));
+            memcpy(header.magic, kCompactMagic, sizeof(header.magic));
+            header.version = 2;
+            header.blockEvents = m_blockEvents;
+            header.eventCount = m_count;
+            header.startNs = m_startNs;
+            header.endNs = m_endNs;
+            
+            header.dictOffset = m_offset;
+            uint32_t dictCount = static_cast<uint32_t>(m_dict.size());
+            m_ok = m_ok && writeAll(&dictCount, sizeof(dictCount));
+            m_ok = m_ok && writeAll(m_dict.data(), m_dict.size() * sizeof(uint32_t));
+            m_offset += sizeof(dictCount) + m_dict.size() * sizeof(uint32_t);
+            
+            header.indexOffset = m_offset;
+            header.indexCount = m_index.size();
+            m_ok = m_ok && writeAll(m_index.data(), m_index.size() * sizeof(CompactIndexEntry));
+            
+            m_ok = m_ok && pwrite(m_fd, &header, sizeof(header), 0) == sizeof(header);
+            close(m_fd);
+            m_fd = -1;
+            return m_ok;
+        }
+
+    private:
+        int m_fd = -1;
+        bool m_ok = false;
+        uint32_t m_blockEvents;
+        uint64_t m_offset = 0;
+        uint64_t m_count = 0;
+        uint64_t m_prevUs = 0;
+        uint64_t m_startNs = 0;
+        uint64_t m_endNs = 0;
+        std::vector<uint8_t> m_buffer;
+        std::vector<uint32_t> m_dict;  // type << 16 | code
+        std::unordered_map<uint32_t, uint32_t> m_dictLookup;
+        std::vector<CompactIndexEntry> m_index;
+
+        bool writeAll(const void* data, size_t size) {
+            const uint8_t* p = static_cast<const uint8_t*>(data);
+            while (size > 0) {
+                ssize_t n = write(m_fd, p, size);
+                if (n <= 0) return false;
+                p += n;
+                size -= n;
+            }
+            return true;
+        }
+
+        void flushBuffer() {
+            if (m_buffer.empty()) return;
+            m_ok = m_ok && writeAll(m_buffer.data(), m_buffer.size());
+            m_offset += m_buffer.size();
+            m_buffer.clear();
+        }
+
+        static void putVarint(std::vector<uint8_t>& out, uint64_t v) {
+            while (v >= 0x80) {
+                out.push_back(static_cast<uint8_t>(v) | 0x80);
+                v >>= 7;
+            }
+            out.push_back(static_cast<uint8_t>(v));
+        }
+
+        static uint64_t zigzag(int64_t v) {
+            return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+        }
+    };
+
+    // Streaming reader over a memory-mapped recording in either format.
+    // Decoding works straight from the mapping without allocating, and
+    // seek() finds a time by binary search (over records for raw files,
+    // over the block index for compact ones).
+    class RecordingReader {
+    public:
+        explicit RecordingReader(const std::string& path) {
+            int fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0) return;
+            struct stat st;
+            if (fstat(fd, &st) == 0 && st.st_size >= static_cast<off_t>(sizeof(RecordingHeader))) {
+                void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (map != MAP_FAILED) {
+                    m_map = static_cast<const uint8_t*>(map);
+                    m_mapSize = st.st_size;
+                }
+            }
+            close(fd);
+            if (m_map && !parse()) {
+                munmap(const_cast<uint8_t*>(m_map), m_mapSize);
+                m_map = nullptr;
+            }
+        }
+
+        ~RecordingReader() {
+            if (m_map) munmap(const_cast<uint8_t*>(m_map), m_mapSize);
+        }
+
+        RecordingReader(const RecordingReader&) = delete;
+        RecordingReader& operator=(const RecordingReader&) = delete;
+
+        bool isOpen() const { return m_map != nullptr; }
+        uint32_t version() const { return m_version; }
+        uint64_t size() const { return m_count; }
+        uint64_t position() const { return m_position; }
+        uint64_t startNs() const { return m_startNs; }
+        uint64_t endNs() const { return m_endNs; }
+
+        bool next(RecordedEvent& ev) {
+            if (m_position >= m_count) return false;
+            if (m_version == 1) {
+                memcpy(&ev, m_records + m_position * sizeof(RecordedEvent), sizeof(ev));
+                m_position++;
+                return true;
+            }
+            if (m_position % m_blockEvents == 0) {
+                CompactIndexEntry entry = indexEntry(m_position / m_blockEvents);
+                m_cursor = m_map + entry.offset;
+                m_prevUs = entry.timeNs / 1000;
+            }
+            uint64_t dt = 0, symbol = 0, value = 0;
+            if (!getVarint(dt) || !getVarint(symbol) || !getVarint(value) || symbol >= m_dictCount) {
+                m_position = m_count;  // truncated or corrupt, stop here
+                return false;
+            }
+            m_prevUs += unzigzag(dt);
+            uint32_t key;
+            memcpy(&key, m_dict + symbol * sizeof(uint32_t), sizeof(key));
+            ev.timeNs = m_prevUs * 1000;
+            ev.type = static_cast<uint16_t>(key >> 16);
+            ev.code = static_cast<uint16_t>(key & 0xFFFF);
+            ev.value = static_cast<int32_t>(unzigzag(value));
+            m_position++;
+            return true;
+        }
+
+        void rewind() {
+            m_position = 0;
+        }
+
+        // Position on the first event at or after `timeNs`
+        void seek(uint64_t timeNs) {
+            if (m_version == 1) {
+                uint64_t lo = 0, hi = m_count;
+                while (lo < hi) {
+                    uint64_t mid = lo + (hi - lo) / 2;
+                    RecordedEvent ev;
+                    memcpy(&ev, m_records + mid * sizeof(RecordedEvent), sizeof(ev));
+                    if (ev.timeNs < timeNs) lo = mid + 1; else hi = mid;
+                }
+                m_position = lo;
+                return;
+            }
+            
+            // Last block starting before the target, then decode forward
+            uint64_t lo = 0, hi = m_indexCount;
+            while (lo < hi) {
+                uint64_t mid = lo + (hi - lo) / 2;
+                if (indexEntry(mid).timeNs < timeNs) lo = mid + 1; else hi = mid;
+            }
+            uint64_t block = lo ? lo - 1 : 0;
+            m_position = block * m_blockEvents;
+            uint64_t blockEnd = std::min(m_count, m_position + m_blockEvents);
+            RecordedEvent ev;
+            while (m_position < blockEnd) {
+                // Keep the cursor so the event can be re-read after stepping back
+                const uint8_t* cursor = m_cursor;
+                uint64_t prevUs = m_prevUs;
+                uint64_t position = m_position;
+                if (!next(ev)) return;
+                if (ev.timeNs >= timeNs) {
+                    m_cursor = cursor;
+                    m_prevUs = prevUs;
+                    m_position = position;
+                    if (position % m_blockEvents == 0) m_cursor = nullptr;
+                    return;
+                }
+            }
+        }
+
+    private:
+        const uint8_t* m_map = nullptr;
+        size_t m_mapSize = 0;
+        uint32_t m_version = 0;
+        uint64_t m_count = 0;
+        uint64_t m_position = 0;
+        uint64_t m_startNs = 0;
+        uint64_t m_endNs = 0;
+        // Raw format
+        const uint8_t* m_records = nullptr;
+        // Compact format
+        uint32_t m_blockEvents = 1;
+        const uint8_t* m_dict = nullptr;
+        uint64_t m_dictCount = 0;
+        const uint8_t* m_index = nullptr;
+        uint64_t m_indexCount = 0;
+        const uint8_t* m_cursor = nullptr;
+        const uint8_t* m_dataEnd = nullptr;
+        uint64_t m_prevUs = 0;
+
+        bool parse() {
+            if (memcmp(m_map, kRecordingMagic, sizeof(kRecordingMagic)) == 0) {
+                RecordingHeader header;
+                memcpy(&header, m_map, sizeof(header));
+                if (header.recordSize != sizeof(RecordedEvent)) return false;
+                m_version = 1;
+                m_records = m_map + sizeof(header);
+                uint64_t available = (m_mapSize - sizeof(header)) / sizeof(RecordedEvent);
+                m_count = header.recordCount ? std::min(header.recordCount, available) : available;
+                // Unfinished files end in zeroed, preallocated space
+                RecordedEvent ev;
+                while (!header.recordCount && m_count > 0) {
+                    memcpy(&ev, m_records + (m_count - 1) * sizeof(ev), sizeof(ev));
+                    if (ev.timeNs != 0) break;
+                    m_count--;
+                }
+                if (m_count) {
+                    memcpy(&ev, m_records, sizeof(ev));
+                    m_startNs = ev.timeNs;
+                    memcpy(&ev, m_records + (m_count - 1) * sizeof(ev), sizeof(ev));
+                    m_endNs = ev.timeNs;
+                }
+                return true;
+            }
+            
+            if (m_mapSize < sizeof(CompactHeader) ||
+                memcmp(m_map, kCompactMagic, sizeof(kCompactMagic)) != 0) return false;
+            CompactHeader header;
+            memcpy(&header, m_map, sizeof(header));
+            if (header.version != 2 || header.blockEvents == 0 ||
+                header.dictOffset + sizeof(uint32_t) > m_mapSize ||
+                header.indexOffset + header.indexCount * sizeof(CompactIndexEntry) > m_mapSize) {
+                return false;
+            }
+            uint32_t dictCount;
+            memcpy(&dictCount, m_map + header.dictOffset, sizeof(dictCount));
+            m_version = 2;
+            m_count = header.eventCount;
+            m_blockEvents = header.blockEvents;
+            m_startNs = header.startNs;
+            m_endNs = header.endNs;
+            m_dict = m_map + header.dictOffset + sizeof(uint32_t);
+            m_dictCount = dictCount;
+            m_index = m_map + header.indexOffset;
+            m_indexCount = header.indexCount;
+            m_dataEnd = m_map + header.dictOffset;
+            return m_indexCount * m_blockEvents >= m_count;
+        }
+
+        CompactIndexEntry indexEntry(uint64_t block) const {
+            CompactIndexEntry entry;
+            memcpy(&entry, m_index + block * sizeof(entry), sizeof(entry));
+            return entry;
+        }
+
+        bool getVarint(uint64_t& v) {
+            v = 0;
+            for (int shift = 0; shift < 64 && m_cursor < m_dataEnd; shift += 7) {
+                uint8_t byte = *m_cursor++;
+                v |= static_cast<uint64_t>(byte & 0x7F) << shift;
+                if (!(byte & 0x80)) return true;
+            }
+            return false;
+        }
+
+        static int64_t unzigzag(uint64_t v) {
+            return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+        }
+    };
+
+    // Convert a recording (typically a raw capture) to the compact format
+    static bool compactRecording(const std::string& inPath, const std::string& outPath) {
+        RecordingReader reader(inPath);
+        if (!reader.isOpen()) {
+            std::cerr << "Cannot read recording " << inPath << std::endl;
+            return false;
+        }
+        RecordingWriter writer(outPath);
+        RecordedEvent ev;
+        while (reader.next(ev)) {
+            if (!writer.add(ev)) return false;
+        }
+        return writer.finish();
+    }
+
+    // Thin out recorded pointer motion. Between key, button and wheel events
+    // the path is simplified with Ramer-Douglas-Peucker, measuring the error
+    // against where the pointer was at the same moment, so it never strays
+    // more than `maxErrorPx` from the original. The result is resampled at
+    // `rateHz` (0 keeps the simplified vertices instead). Steps are taken
+    // from the rounded running position, so every anchored event and the
+    // end of the recording happen at exactly the original pixel.
+    static std::vector<RecordedEvent> simplifyMotion(const std::vector<RecordedEvent>& events,
+                                                     double maxErrorPx = 1.0, int rateHz = 125) {
+        std::vector<RecordedEvent> out;
+        out.reserve(events.size() / 4);
+        std::vector<PathPoint> path;
+        int64_t x = 0, y = 0;
+        for (const RecordedEvent& ev : events) {
+            if (ev.type == EV_REL && (ev.code == REL_X || ev.code == REL_Y)) {
+                if (path.empty()) path.push_back({ev.timeNs, x, y});
+                (ev.code == REL_X ? x : y) += ev.value;
+                if (path.size() > 1 && path.back().timeNs == ev.timeNs) {
+                    path.back().x = x;
+                    path.back().y = y;
+                } else {
+                    path.push_back({ev.timeNs, x, y});
+                }
+            } else if (ev.type != EV_SYN) {
+                // The pointer must be in place before this event
+                emitSimplifiedPath(path, maxErrorPx, rateHz, out);
+                path.clear();
+                out.push_back(ev);
+            }
+        }
+        emitSimplifiedPath(path, maxErrorPx, rateHz, out);
+        return out;
+    }
+
+    static bool simplifyRecording(const std::string& inPath, const std::string& outPath,
+                                  double maxErrorPx = 1.0, int rateHz = 125) {
+        RecordingReader reader(inPath);
+        if (!reader.isOpen()) {
+            std::cerr << "Cannot read recording " << inPath << std::endl;
+            return false;
+        }
+        std::vector<RecordedEvent> events;
+        events.reserve(reader.size());
+        RecordedEvent ev;
+        while (reader.next(ev)) events.push_back(ev);
+        
+        RecordingWriter writer(outPath);
+        for (const RecordedEvent& e : simplifyMotion(events, maxErrorPx, rateHz)) {
+            if (!writer.add(e)) return false;
+        }
+        return writer.finish();
+    }
+
+    // Part of a recording to replay, as offsets from its first event
+    struct ReplayRange {
+        ReplayRange() : fromNs(0), toNs(UINT64_MAX) {}
+        ReplayRange(uint64_t from, uint64_t to) : fromNs(from), toNs(to) {}
+        uint64_t fromNs;
+        uint64_t toNs;
+    };
+
+    struct ReplayStats {
+        uint64_t events = 0;
+        uint64_t reports = 0;
+        uint64_t loops = 0;
+        LatencyHistogram timingError;  // lateness of each event against its deadline
+    };
+
+    // Re-emit a recording through the virtual device on the scheduler.
+    // Every event is due at an absolute deadline derived from its recorded
+    // timestamp divided by `speed`; events sharing a timestamp go out as
+    // one report. Cancelling releases every key and button still held.
+    TaskId replay(const std::string& path, double speed = 1.0,
+                  ReplayRange range = ReplayRange(), bool loop = false) {
+        if (speed <= 0.0) return 0;
+        auto state = std::make_shared<ReplayState>(path);
+        if (!state->reader.isOpen()) {
+            std::cerr << "Cannot read recording " << path << std::endl;
+            return 0;
+        }
+        if (state->reader.size() == 0) return 0;
+        
+        state->speed = speed;
+        state->loop = loop;
+        state->fromNs = state->reader.startNs() + std::min(range.fromNs, UINT64_MAX - state->reader.startNs());
+        state->toNs = state->reader.startNs() + std::min(range.toNs, UINT64_MAX - state->reader.startNs());
+        state->reader.seek(state->fromNs);
+        state->havePending = state->reader.next(state->pending) && state->pending.timeNs <= state->toNs;
+        if (!state->havePending) return 0;
+        
+        // A loop lasts as long as the range, or from first to last event when open-ended
+        uint64_t spanNs = std::min(state->toNs, state->reader.endNs()) - state->fromNs;
+        state->loopPeriod = std::chrono::duration_cast<SchedClock::duration>(
+            std::chrono::duration<double, std::nano>(std::max<uint64_t>(spanNs, 1000000) / speed));
+        state->origin = SchedClock::now();
+        
+        auto run = [this, state](SchedClock::time_point& due, EventBatch& batch) {
+            return replayStep(*state, due, batch);
+        };
+        auto onStop = [this, state](EventBatch& batch) {
+            releaseReplayHeld(*state, batch);
+        };
+        TaskId id = scheduleTask(replayDeadline(*state, state->pending.timeNs), run, onStop);
+        
+        std::lock_guard<std::mutex> lock(m_schedMutex);
+        if (m_schedTasks.count(id)) {
+            m_replays[id] = state;
+        } else {
+            keepFinishedReplay(id, replayStats(*state));  // already done
+        }
+        return id;
+    }
+
+    // Stats of a running replay, or the final ones of a recent replay
+    ReplayStats getReplayStats(TaskId id) {
+        std::shared_ptr<ReplayState> state;
+        {
+            std::lock_guard<std::mutex> lock(m_schedMutex);
+            auto it = m_replays.find(id);
+            if (it == m_replays.end()) {
+                auto done = m_finishedReplays.find(id);
+                return done != m_finishedReplays.end() ? done->second : ReplayStats();
+            }
+            state = it->second;
+        }
+        return replayStats(*state);
+    }
+
+    enum class FlightSource : uint32_t {
+        Captured = 0,  // read from a physical device
+        Injected = 1,  // written to a virtual device
+    };
+
+    struct FlightEvent {
+        uint64_t sequence;
+        uint64_t timeNs;  // CLOCK_MONOTONIC
+        uint16_t type;
+        uint16_t code;
+        int32_t value;
+        FlightSource source;
+    };
+
+    // Keep the most recent `capacity` captured and injected events in a
+    // ring inside a shared memory file (default /dev/shm/inpctrl-flight-<pid>).
+    // Writers claim slots with one atomic add and never block, and the file
+    // outlives a crashed process, so dumpFlightRecorder() can read it from
+    // another process. 64Ki slots hold about ten seconds of a 1000 Hz mouse.
+    bool startFlightRecorder(size_t capacity = 1 << 16, const std::string& path = "") {
+        std::lock_guard<std::mutex> lock(m_flightMutex);
+        if (!m_flightMap) {
+            size_t slots = 1;
+            while (slots < capacity) slots <<= 1;
+            std::string file = path.empty()
+                ? "/dev/shm/inpctrl-flight-" + std::to_string(getpid()) : path;
+            size_t size = sizeof(FlightHeader) + slots * sizeof(FlightSlot);
+            
+            int fd = open(file.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0) {
+                std::cerr << "Failed to create " << file << ": " << strerror(errno) << std::endl;
+                return false;
+            }
+            void* map = MAP_FAILED;
+            if (ftruncate(fd, size) == 0) {
+                map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            }
+            close(fd);
+            if (map == MAP_FAILED) {
+                std::cerr << "Failed to map flight recorder: " << strerror(errno) << std::endl;
+                unlink(file.c_str());
+                return false;
+            }
+            
+            // ftruncate zero-fills, so every slot starts out empty
+            FlightHeader* header = static_cast<FlightHeader*>(map);
+            memcpy(header->magic, kFlightMagic, sizeof(header->magic));
+            header->version = 1;
+            header->slotSize = sizeof(FlightSlot);
+            header->capacity = slots;
+            header->pid = getpid();
+            m_flightMap = header;
+            m_flightMapSize = size;
+            m_flightPath = file;
+        }
+        m_flightRing.store(m_flightMap, std::memory_order_release);
+        return true;
+    }
+
+    // Stop logging; the region stays mapped and readable until cleanup()
+    void stopFlightRecorder() {
+        m_flightRing.store(nullptr, std::memory_order_release);
+    }
+
+    std::string getFlightRecorderPath() {
+        std::lock_guard<std::mutex> lock(m_flightMutex);
+        return m_flightPath;
+    }
+
+    // Read a flight recorder region, oldest event first. With `lastNs` set,
+    // only events within that long of the newest one are returned.
+    static std::vector<FlightEvent> dumpFlightRecorder(const std::string& path, uint64_t lastNs = 0) {
+        std::vector<FlightEvent> events;
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            std::cerr << "Cannot open " << path << ": " << strerror(errno) << std::endl;
+            return events;
+        }
+        struct stat st;
+        void* map = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && st.st_size >= static_cast<off_t>(sizeof(FlightHeader))) {
+            map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        }
+        close(fd);
+        if (map == MAP_FAILED) return events;
+        
+        const FlightHeader* header = static_cast<const FlightHeader*>(map);
+        if (memcmp(header->magic, kFlightMagic, sizeof(kFlightMagic)) != 0 ||
+            header->slotSize != sizeof(FlightSlot) || header->capacity == 0 ||
+            sizeof(FlightHeader) + header->capacity * sizeof(FlightSlot) > static_cast<size_t>(st.st_size)) {
+            munmap(map, st.st_size);
+            return events;
+        }
+        
+        const FlightSlot* slots = reinterpret_cast<const FlightSlot*>(header + 1);
+        uint64_t head = header->head.load(std::memory_order_acquire);
+        uint64_t first = head > header->capacity ? head - header->capacity : 0;
+        events.reserve(head - first);
+        for (uint64_t n = first; n < head; ++n) {
+            const FlightSlot& slot = slots[n & (header->capacity - 1)];
+            // Skip slots being written or already overwritten by a newer event
+            uint64_t seq = slot.seq.load(std::memory_order_acquire);
+            FlightEvent ev;
+            ev.sequence = n;
+            ev.timeNs = slot.timeNs;
+            ev.type = slot.type;
+            ev.code = slot.code;
+            ev.value = slot.value;
+            ev.source = static_cast<FlightSource>(slot.source);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (seq != 2 * n + 2 || slot.seq.load(std::memory_order_relaxed) != seq) continue;
+            events.push_back(ev);
+        }
+        munmap(map, st.st_size);
+        
+        if (lastNs && !events.empty()) {
+            uint64_t newest = 0;
+            for (const FlightEvent& ev : events) newest = std::max(newest, ev.timeNs);
+            events.erase(std::remove_if(events.begin(), events.end(), [&](const FlightEvent& ev) {
+                return ev.timeNs + lastNs < newest;
+            }), events.end());
+        }
+        return events;
+    }
+
+    // Fixed key sequences translated to input_events at compile time:
+    //   static constexpr auto copyPaste = CrossInput::keySequence(
+    //       CrossInput::chord(Key::LCtrl, Key::A), CrossInput::chord(Key::LCtrl, Key::C),
+    //       CrossInput::chord(Key::LAlt, Key::Tab), CrossInput::chord(Key::LCtrl, Key::V));
+    //   input.send(copyPaste);
+    // A Key step is a tap, a chord presses its keys in one report and
+    // releases them in the next, and pause(ms) splits the sequence.
+    template<size_t N>
+    struct KeyChord {
+        Key keys[N];
+    };
+
+    struct SequencePause {
+        uint32_t ms;
+    };
+
+    // Segment i runs from splits[i] to splits[i + 1] (or the end) and is
+    // followed by a pause of delaysMs[i]
+    template<size_t N, size_t P>
+    struct EventSequence {
+        std::array<struct input_event, N> events;
+        std::array<size_t, P + 1> splits;
+        std::array<uint32_t, P + 1> delaysMs;
+    };
+
+    template<typename... Keys>
+    static constexpr KeyChord<sizeof...(Keys)> chord(Keys... keys) {
+        return KeyChord<sizeof...(Keys)>{{keys...}};
+    }
+
+    static constexpr SequencePause pause(uint32_t ms) {
+        return SequencePause{ms};
+    }
+
+    template<typename... Steps>
+    static constexpr auto keySequence(Steps... steps) {
+        constexpr size_t events = (sequenceEvents(Steps{}) + ... + 0);
+        constexpr size_t pauses = (std::is_same<Steps, SequencePause>::value + ... + 0);
+        EventSequence<events, pauses> seq{};
+        size_t at = 0, segment = 0;
+        (appendSequenceStep(seq, at, segment, steps), ...);
+        return seq;
+    }
+
+    // Untimed sequences go out with a single write(); sequences with
+    // pauses run on the scheduler, one prebuilt segment per deadline, and
+    // their task id is stored in `task`. Returns false if nothing was sent.
+    template<size_t N, size_t P>
+    bool send(const EventSequence<N, P>& seq, TaskId* task = nullptr) {
+        if (task) *task = 0;
+        if (m_uinputFd < 0) return false;
+        if constexpr (P == 0) {
+            return emitEvents(seq.events.data(), N);
+        } else {
+            auto plan = std::make_shared<const EventSequence<N, P>>(seq);
+            auto segment = std::make_shared<size_t>(0);
+            auto run = [plan, segment](SchedClock::time_point& due, EventBatch& batch) {
+                size_t i = (*segment)++;
+                size_t end = i < P ? plan->splits[i + 1] : N;
+                batch.append(plan->events.data() + plan->splits[i], end - plan->splits[i]);
+                if (i == P) return false;
+                due += std::chrono::milliseconds(plan->delaysMs[i]);
+                return true;
+            };
+            TaskId id = scheduleTask(SchedClock::now(), run);
+            if (task) *task = id;
+            return true;
+        }
+    }
+
+    // ========================================================================
+    // AUTOREPEAT
+    // ========================================================================
+    
+    // Repeat injected key holds (value 2 events) after delayMs, at rateHz,
+    // until they are released. With Options::kernelRepeat the device
+    // advertises EV_REP and this sets the kernel's delay and period instead.
+    // A rate of 0 turns repeating off. Returns false if the kernel's
+    // settings could not be written.
+    bool setAutoRepeat(int delayMs = 500, double rateHz = 30.0) {
+        delayMs = std::max(delayMs, 0);
+        if (m_options.kernelRepeat) {
+            if (m_uinputFd < 0) return false;
+            struct input_event ev[3];
+            memset(ev, 0, sizeof(ev));
+            ev[0].type = EV_REP;
+            ev[0].code = REP_DELAY;
+            ev[0].value = delayMs;
+            ev[1].type = EV_REP;
+            ev[1].code = REP_PERIOD;
+            ev[1].value = rateHz > 0 ? std::max(1, static_cast<int>(std::lround(1000.0 / rateHz))) : 0;
+            ev[2].type = EV_SYN;
+            ev[2].code = SYN_REPORT;
+            return emitEvents(ev, 3);
+        }
+        
+        std::lock_guard<std::mutex> lock(m_repeatMutex);
+        if (rateHz <= 0) {
+            m_repeatEnabled = false;
+            m_repeatHeld.clear();
+            return true;
+        }
+        m_repeatDelay = std::chrono::milliseconds(delayMs);
+        m_repeatPeriod = std::chrono::duration_cast<SchedClock::duration>(
+            std::chrono::duration<double>(1.0 / std::min(rateHz, 1000.0)));
+        m_repeatEnabled = true;
+        return true;
+    }
+    
+    bool disableAutoRepeat() {
+        return setAutoRepeat(0, 0.0);
+    }
+    
+    // ========================================================================
+    // REACTOR
+    // ========================================================================
+    
+    // Run `fn` on the reactor thread (Options::mode = Mode::Reactor), or in
+    // the next pump() in Manual mode. Output it injects joins that pass's
+    // single write. Returns false when neither is set up. `fn` must not
+    // block or wait for tasks.
+    bool post(std::function<void()> fn) {
+        if (m_reactorFd < 0) return false;
+        {
+            std::lock_guard<std::mutex> lock(m_reactorMutex);
+            m_reactorQueue.push_back(std::move(fn));
+        }
+        wakeReactor();
+        return true;
+    }
+    
+    // System calls the reactor made per event it read or wrote
+    struct IoStats {
+        bool ioUring = false;     // backend in use
+        uint64_t syscalls = 0;
+        uint64_t eventsIn = 0;    // read from devices
+        uint64_t eventsOut = 0;   // written to uinput from the reactor thread
+        double syscallsPerEvent = 0.0;
+    };
+    
+    IoStats getIoStats() const {
+        IoStats stats;
+#ifdef INPCTRL_IO_URING
+        stats.ioUring = m_uring.fd >= 0;
+#endif
+        stats.syscalls = m_ioSyscalls.load(std::memory_order_relaxed);
+        stats.eventsIn = m_ioEventsIn.load(std::memory_order_relaxed);
+        stats.eventsOut = m_ioEventsOut.load(std::memory_order_relaxed);
+        uint64_t events = stats.eventsIn + stats.eventsOut;
+        if (events) stats.syscallsPerEvent = static_cast<double>(stats.syscalls) / events;
+        return stats;
+    }
+    
+    void resetIoStats() {
+        m_ioSyscalls = 0;
+        m_ioEventsIn = 0;
+        m_ioEventsOut = 0;
+    }
+#endif
+
+private:
+    Options m_options;
+    std::unordered_map<unsigned int, bool> m_keyStates;
+    std::mutex m_keyMutex;
+    std::thread m_listenerThread;
+    std::atomic<bool> m_running;
+    bool m_initialized;
+
+    // Lock-free accumulator behind LatencyHistogram, safe to record from
+    // one thread while others take snapshots
+    struct LatencyRecorder {
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> totalNs{0};
+        std::atomic<uint64_t> minNs{UINT64_MAX};
+        std::atomic<uint64_t> maxNs{0};
+        std::atomic<uint64_t> buckets[LatencyHistogram::kBuckets] = {};
+
+        void record(uint64_t ns) {
+            uint64_t us = ns / 1000;
+            int bucket = 0;
+            while (bucket < LatencyHistogram::kBuckets - 1 && (1ULL << bucket) <= us) {
+                bucket++;
+            }
+            buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+            count.fetch_add(1, std::memory_order_relaxed);
+            totalNs.fetch_add(ns, std::memory_order_relaxed);
+            uint64_t prev = minNs.load(std::memory_order_relaxed);
+            while (ns < prev && !minNs.compare_exchange_weak(prev, ns, std::memory_order_relaxed)) {}
+            prev = maxNs.load(std::memory_order_relaxed);
+            while (ns > prev && !maxNs.compare_exchange_weak(prev, ns, std::memory_order_relaxed)) {}
+        }
+
+        LatencyHistogram snapshot() const {
+            LatencyHistogram h;
+            h.count = count.load(std::memory_order_relaxed);
+            h.totalNs = totalNs.load(std::memory_order_relaxed);
+            h.minNs = h.count ? minNs.load(std::memory_order_relaxed) : 0;
+            h.maxNs = maxNs.load(std::memory_order_relaxed);
+            for (int i = 0; i < LatencyHistogram::kBuckets; ++i) {
+                h.buckets[i] = buckets[i].load(std::memory_order_relaxed);
+            }
+            return h;
+        }
+
+        void reset() {
+            count = 0;
+            totalNs = 0;
+            minNs = UINT64_MAX;
+            maxNs = 0;
+            for (auto& b : buckets) b = 0;
+        }
+    };
+
+    mutable std::mutex m_rtMutex;
+    RealtimeStatus m_rtStatus;
+    LatencyRecorder m_timerLatency;
+    LatencyRecorder m_pickupLatency;
+
+    bool realtimeRequested() const {
+        return m_options.schedPolicy != SchedPolicy::Other || !m_options.cpus.empty() ||
+               m_options.lockMemory || m_options.prefaultBytes > 0;
+    }
+
+    // Record the first real-time failure; always returns false
+    bool realtimeFailed(const std::string& what, int err = 0) {
+        std::string error = what;
+        if (err != 0) error += std::string(": ") + strerror(err);
+        if (err == EPERM && what.compare(0, 6, "SCHED_") == 0) {
+            error += " (needs CAP_SYS_NICE or RLIMIT_RTPRIO)";
+        } else if ((err == EPERM || err == ENOMEM) && what == "mlockall") {
+            error += " (needs CAP_IPC_LOCK or a larger RLIMIT_MEMLOCK)";
+        }
+        std::cerr << "Real-time setting failed, " << error << std::endl;
+        std::lock_guard<std::mutex> lock(m_rtMutex);
+        if (m_rtStatus.ok) {
+            m_rtStatus.ok = false;
+            m_rtStatus.error = error;
+        }
+        return false;
+    }
+
+    // Process-wide part of the real-time options, applied first by init()
+    bool applyProcessRealtime() {
+        {
+            std::lock_guard<std::mutex> lock(m_rtMutex);
+            m_rtStatus = RealtimeStatus();
+        }
+#ifdef _WIN32
+        if (realtimeRequested()) return realtimeFailed("real-time options are only supported on Linux");
+#else
+        if (m_options.schedPolicy != SchedPolicy::Other &&
+            (m_options.schedPriority < sched_get_priority_min(SCHED_FIFO) ||
+             m_options.schedPriority > sched_get_priority_max(SCHED_FIFO))) {
+            return realtimeFailed("priority " + std::to_string(m_options.schedPriority) + " out of range");
+        }
+        if (m_options.lockMemory && mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+            return realtimeFailed("mlockall", errno);
+        }
+        if (m_options.prefaultBytes > 0) {
+            // Grow the output batches once so flushing never allocates
+            for (EventBatch* batch : {&m_listenerBatch, &m_schedBatch}) {
+                batch->events.resize(4096);
+                batch->clear();
+            }
+        }
+#endif
+        return true;
+    }
+
+    // Apply the per-thread real-time options to a thread CrossInput
+    // started. `cpu` pins it to one core instead of Options::cpus.
+    bool configureThread(std::thread& thread, const char* name, int cpu = -1) {
+#ifdef _WIN32
+        (void)thread;
+        (void)name;
+        (void)cpu;
+        return true;
+#else
+        pthread_t handle = thread.native_handle();
+        if (m_options.nameThreads) pthread_setname_np(handle, name);
+        
+        if (cpu >= 0 || !m_options.cpus.empty()) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for (int c : cpu >= 0 ? std::vector<int>{cpu} : m_options.cpus) {
+                if (c < 0 || c >= CPU_SETSIZE) return realtimeFailed("CPU " + std::to_string(c) + " out of range");
+                CPU_SET(c, &set);
+            }
+            int err = pthread_setaffinity_np(handle, sizeof(set), &set);
+            if (err != 0) return realtimeFailed(std::string(name) + " affinity", err);
+        }
+        
+        if (m_options.schedPolicy != SchedPolicy::Other) {
+            struct sched_param param;
+            memset(&param, 0, sizeof(param));
+            param.sched_priority = m_options.schedPriority;
+            bool fifo = m_options.schedPolicy == SchedPolicy::Fifo;
+            int err = pthread_setschedparam(handle, fifo ? SCHED_FIFO : SCHED_RR, &param);
+            if (err != 0) return realtimeFailed(std::string(fifo ? "SCHED_FIFO" : "SCHED_RR") + " for " + name, err);
+        }
+        return true;
+#endif
+    }
+
+    // First thing an owned thread does: fault in the stack it may use so
+    // the hot path never takes a page fault. Capped at what is left of the
+    // thread's stack, less a margin for the frames that follow.
+    void prepareThread() {
+#ifndef _WIN32
+        if (m_options.prefaultBytes == 0) return;
+        pthread_attr_t attr;
+        if (pthread_getattr_np(pthread_self(), &attr) != 0) return;
+        void* base = nullptr;
+        size_t size = 0;
+        int err = pthread_attr_getstack(&attr, &base, &size);
+        pthread_attr_destroy(&attr);
+        if (err != 0) return;
+        
+        constexpr size_t kMargin = 64 * 1024;
+        char here;
+        size_t left = static_cast<size_t>(&here - static_cast<char*>(base));
+        if (left <= kMargin) return;
+        size_t bytes = std::min(m_options.prefaultBytes, left - kMargin);
+        volatile char* stack = static_cast<volatile char*>(alloca(bytes));
+        for (size_t i = 0; i < bytes; i += 4096) stack[i] = 0;
+#endif
+    }
+
+    static double applyCurve(PathCurve curve, double t) {
+        switch (curve) {
+            case PathCurve::EaseIn:    return t * t;
+            case PathCurve::EaseOut:   return t * (2.0 - t);
+            case PathCurve::EaseInOut: return t * t * (3.0 - 2.0 * t);
+            default:                   return t;
+        }
+    }
+
+    // Bounding box of all configured monitors; false if none are configured
+    bool desktopBounds(int& minX, int& minY, int& maxX, int& maxY) const {
+        if (m_options.monitors.empty()) return false;
+        minX = minY = INT32_MAX;
+        maxX = maxY = INT32_MIN;
+        for (const Monitor& m : m_options.monitors) {
+            minX = std::min(minX, m.x);
+            minY = std::min(minY, m.y);
+            maxX = std::max(maxX, m.x + m.width - 1);
+            maxY = std::max(maxY, m.y + m.height - 1);
+        }
+        return maxX > minX && maxY > minY;
+    }
+
+    static bool isMouseButton(Key key) {
+        return key == Key::LMB || key == Key::RMB || key == Key::MMB ||
+               key == Key::Mouse4 || key == Key::Mouse5;
+    }
+
+    // Type a single character
+    void typeChar(char c, int delayMs = 30) {
+#ifdef _WIN32
+        typeCharWindows(c, delayMs);
+#else
+        typeCharLinux(c, delayMs);
+#endif
+    }
+
+#ifdef _WIN32
+    // ==================== WINDOWS IMPLEMENTATION ====================
+    HHOOK m_hookHandle;
+    
+    static CrossInput* s_instance;  // Declaration only
+    
+    static LRESULT CALLBACK keyboardHookProc(int nCode, WPARAM wParam, LPARAM lParam) {
+        if (nCode == HC_ACTION && s_instance) {
+            const KBDLLHOOKSTRUCT* pkbhs = reinterpret_cast<const KBDLLHOOKSTRUCT*>(lParam);
+            
+            // Only track non-injected keys
+            if ((pkbhs->flags & LLKHF_INJECTED) == 0) {
+                bool isDown = (wParam == WM_KEYDOWN || wParam == WM_SYSKEYDOWN);
+                
+                {
+                    std::lock_guard<std::mutex> lock(s_instance->m_keyMutex);
+                    s_instance->m_keyStates[pkbhs->vkCode] = isDown;
+                }
+                s_instance->turboTriggerEdge(pkbhs->vkCode, isDown);
+            }
+            // GetAsyncKeyState includes injected keys, so their edges count too
+            bool down = (wParam == WM_KEYDOWN || wParam == WM_SYSKEYDOWN);
+            s_instance->notifyKeyWaiters(pkbhs->vkCode, down);
+        }
+        return CallNextHookEx(s_instance->m_hookHandle, nCode, wParam, lParam);
+    }
+    
+    bool initWindows() {
+        s_instance = this;
+        
+        if (m_options.monitors.empty()) {
+            EnumDisplayMonitors(NULL, NULL, addMonitorProc, reinterpret_cast<LPARAM>(&m_options.monitors));
+        }
+        
+        // Install keyboard hook
+        m_hookHandle = SetWindowsHookEx(
+            WH_KEYBOARD_LL, 
+            keyboardHookProc, 
+            GetModuleHandle(NULL), 
+            0
+        );
+        
+        if (!m_hookHandle) {
+            std::cerr << "Failed to install keyboard hook. Error: " << GetLastError() << std::endl;
+            return false;
+        }
+        
+        m_running = true;
+        
+        if (m_options.mode == Mode::Manual) {
+            // pump() dispatches the hook and runs tasks queued before init
+            stopSchedulerThread();
+        } else {
+            // Start message pump thread for the hook
+            m_listenerThread = std::thread([this]() { 
+                windowsEventLoop(); 
+            });
+        }
+        
+        m_initialized = true;
+        std::cout << "Windows input initialized (using GetAsyncKeyState + hook)" << std::endl;
+        return true;
+    }
+    
+    void cleanupWindows() {
+        if (m_hookHandle) {
+            UnhookWindowsHookEx(m_hookHandle);
+            m_hookHandle = NULL;
+        }
+        s_instance = nullptr;
+    }
+    
+    void windowsEventLoop() {
+        MSG msg;
+        // Process messages to keep hook alive
+        while (m_running) {
+            while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
+                TranslateMessage(&msg);
+                DispatchMessage(&msg);
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    
+    // The hook only runs while its installing thread pumps messages, so
+    // Manual mode must call init() and pump() from the same thread
+    void pumpWindows(int timeoutMs) {
+        // Wake for input or the next timed action, whichever comes first
+        DWORD wait = timeoutMs < 0 ? INFINITE : static_cast<DWORD>(timeoutMs);
+        {
+            std::lock_guard<std::mutex> lock(m_schedMutex);
+            if (!m_schedQueue.empty()) {
+                auto left = std::chrono::ceil<std::chrono::milliseconds>(m_schedQueue.front().first - SchedClock::now());
+                wait = std::min<DWORD>(wait, static_cast<DWORD>(std::max<int64_t>(left.count(), 0)));
+            }
+        }
+        MsgWaitForMultipleObjectsEx(0, NULL, wait, QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+        
+        MSG msg;
+        while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
+            TranslateMessage(&msg);
+            DispatchMessage(&msg);
+        }
+        std::unique_lock<std::mutex> lock(m_schedMutex);
+        runDueTasks(lock, m_schedBatch);
+    }
+    
+    static INPUT keyInputWindows(unsigned int vkCode, bool up) {
+        INPUT input = {0};
+        input.type = INPUT_KEYBOARD;
+        
+        // For the slash key (and other OEM keys), use scan code
+        if (vkCode == 0xBF) {  // VK_OEM_2 (slash key)
+            input.ki.wScan = 0x35;  // Hardware scan code for /
+            input.ki.dwFlags = KEYEVENTF_SCANCODE;
+        } else {
+            input.ki.wVk = vkCode;
+            input.ki.wScan = MapVirtualKey(vkCode, MAPVK_VK_TO_VSC);
+            input.ki.dwFlags = 0;
+        }
+        if (up) input.ki.dwFlags |= KEYEVENTF_KEYUP;
+        return input;
+    }
+
+    void holdKeyWindows(unsigned int vkCode) {
+        INPUT input = keyInputWindows(vkCode, false);
+        SendInput(1, &input, sizeof(INPUT));
+    }
+
+    void releaseKeyWindows(unsigned int vkCode) {
+        INPUT input = keyInputWindows(vkCode, true);
+        SendInput(1, &input, sizeof(INPUT));
+    }
+    
+    // Inputs collected for a single SendInput call
+    struct EventBatch {
+        std::vector<INPUT> inputs;
+        bool empty() const { return inputs.empty(); }
+        void clear() { inputs.clear(); }
+    };
+
+    void emitBatch(EventBatch& batch) {
+        if (!batch.empty()) {
+            SendInput(static_cast<UINT>(batch.inputs.size()), batch.inputs.data(), sizeof(INPUT));
+        }
+        batch.clear();
+    }
+
+    // Every INPUT is delivered on its own, there is no report framing
+    void endReport(EventBatch&) {}
+
+    void queueButton(EventBatch& batch, Key button, bool down) {
+        INPUT input = {0};
+        input.type = INPUT_MOUSE;
+        switch (button) {
+            case Key::LMB: input.mi.dwFlags = down ? MOUSEEVENTF_LEFTDOWN : MOUSEEVENTF_LEFTUP; break;
+            case Key::RMB: input.mi.dwFlags = down ? MOUSEEVENTF_RIGHTDOWN : MOUSEEVENTF_RIGHTUP; break;
+            case Key::MMB: input.mi.dwFlags = down ? MOUSEEVENTF_MIDDLEDOWN : MOUSEEVENTF_MIDDLEUP; break;
+            case Key::Mouse4:
+            case Key::Mouse5:
+                input.mi.dwFlags = down ? MOUSEEVENTF_XDOWN : MOUSEEVENTF_XUP;
+                input.mi.mouseData = (button == Key::Mouse4) ? XBUTTON1 : XBUTTON2;
+                break;
+            default: return;
+        }
+        batch.inputs.push_back(input);
+    }
+
+    void queueMove(EventBatch& batch, int dx, int dy) {
+        INPUT input = {0};
+        input.type = INPUT_MOUSE;
+        input.mi.dwFlags = MOUSEEVENTF_MOVE;
+        input.mi.dx = dx;
+        input.mi.dy = dy;
+        batch.inputs.push_back(input);
+    }
+
+    // Windows wheel data is already in 1/120 notch units
+    void queueScroll(EventBatch& batch, int hiResV, int hiResH) {
+        INPUT input = {0};
+        input.type = INPUT_MOUSE;
+        if (hiResV) {
+            input.mi.dwFlags = MOUSEEVENTF_WHEEL;
+            input.mi.mouseData = static_cast<DWORD>(hiResV);
+            batch.inputs.push_back(input);
+        }
+        if (hiResH) {
+            input.mi.dwFlags = MOUSEEVENTF_HWHEEL;
+            input.mi.mouseData = static_cast<DWORD>(hiResH);
+            batch.inputs.push_back(input);
+        }
+    }
+
+    static BOOL CALLBACK addMonitorProc(HMONITOR, HDC, LPRECT rect, LPARAM data) {
+        Monitor m;
+        m.x = rect->left;
+        m.y = rect->top;
+        m.width = rect->right - rect->left;
+        m.height = rect->bottom - rect->top;
+        reinterpret_cast<std::vector<Monitor>*>(data)->push_back(m);
+        return TRUE;
+    }
+
+    bool moveMouseToWindows(int x, int y) {
+        // Absolute SendInput coordinates are normalized to 0..65535 across
+        // the virtual desktop
+        int left = GetSystemMetrics(SM_XVIRTUALSCREEN);
+        int top = GetSystemMetrics(SM_YVIRTUALSCREEN);
+        int width = GetSystemMetrics(SM_CXVIRTUALSCREEN);
+        int height = GetSystemMetrics(SM_CYVIRTUALSCREEN);
+        if (width <= 1 || height <= 1) return false;
+        
+        INPUT input = {0};
+        input.type = INPUT_MOUSE;
+        input.mi.dwFlags = MOUSEEVENTF_MOVE | MOUSEEVENTF_ABSOLUTE | MOUSEEVENTF_VIRTUALDESK;
+        input.mi.dx = static_cast<LONG>((static_cast<long long>(x - left) * 65535) / (width - 1));
+        input.mi.dy = static_cast<LONG>((static_cast<long long>(y - top) * 65535) / (height - 1));
+        return SendInput(1, &input, sizeof(INPUT)) == 1;
+    }
+
+    void moveMouseWindows(int dx, int dy) {
+        INPUT input = {0};
+        input.type = INPUT_MOUSE;
+        input.mi.dwFlags = MOUSEEVENTF_MOVE;
+        input.mi.dx = dx;
+        input.mi.dy = dy;
+        SendInput(1, &input, sizeof(INPUT));
+    }
+
+    void typeCharWindows(char c, int delayMs) {
+        // Convert char to virtual key and shift state
+        SHORT vk = VkKeyScanA(c);
+        if (vk == -1) {
+            // Character not available in current keyboard layout
+            std::cerr << "Character '" << c << "' not available in keyboard layout" << std::endl;
+            return;
+        }
+        
+        BYTE keyCode = LOBYTE(vk);
+        BYTE shiftState = HIBYTE(vk);
+        
+        // Press shift if needed
+        bool needShift = (shiftState & 1);
+        bool needCtrl = (shiftState & 2);
+        bool needAlt = (shiftState & 4);
+        
+        if (needShift) holdKeyWindows(VK_SHIFT);
+        if (needCtrl) holdKeyWindows(VK_CONTROL);
+        if (needAlt) holdKeyWindows(VK_MENU);
+        
+        // Press the key
+        holdKeyWindows(keyCode);
+        std::this_thread::sleep_for(std::chrono::milliseconds(delayMs));
+        releaseKeyWindows(keyCode);
+        
+        // Release modifiers
+        if (needAlt) releaseKeyWindows(VK_MENU);
+        if (needCtrl) releaseKeyWindows(VK_CONTROL);
+        if (needShift) releaseKeyWindows(VK_SHIFT);
+    }
+
+    Key getCurrentPressedKeyWindows(int timeout_ms) {
+        auto startTime = std::chrono::steady_clock::now();
+        
+        do {
+            // Check all possible virtual key codes
+            for (unsigned int vk = 0x01; vk <= 0xFE; vk++) {
+                // Check if key is pressed
+                if (GetAsyncKeyState(vk) & 0x8000) {
+                    // Wait for key to be released before returning
+                    while (GetAsyncKeyState(vk) & 0x8000) {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                    }
+                    return static_cast<Key>(vk);
+                }
+            }
+            
+            if (timeout_ms == 0) {
+                break; // No wait, check once
+            }
+            
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            
+            if (timeout_ms > 0) {
+                auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now() - startTime
+                ).count();
+                if (elapsed >= timeout_ms) {
+                    break;
+                }
+            }
+            
+        } while (timeout_ms != 0);
+        
+        return static_cast<Key>(0); // No key pressed
+    }
+#else
+    // ==================== LINUX IMPLEMENTATION ====================
+    int m_uinputFd;
+    int m_absFd = -1;  // absolute pointer device, only with configured monitors
+    std::mutex m_absMutex;  // guards the last position and orders the writes
+    int m_absLastX = INT32_MIN, m_absLastY = INT32_MIN;
+    std::atomic<int> m_wheelRemainder[2] = {};  // hi-res units short of a full notch
+
+    // ---------- Debounce ----------
+    struct DebounceConfig {
+        DebounceMode mode = DebounceMode::Off;
+        uint32_t thresholdUs[KEY_CNT];
+    };
+
+    // Per-device filter state indexed by evdev code
+    struct KeyDebouncer {
+        uint64_t lastEdgeNs[KEY_CNT] = {};  // timestamp of the last edge let through
+        uint64_t deadlineNs[KEY_CNT] = {};  // pending resolution time, 0 if none
+        uint8_t raw[KEY_CNT] = {};          // state as last reported by the hardware
+        uint8_t reported[KEY_CNT] = {};     // state as passed on to everything else
+        std::vector<uint16_t> pending;      // codes that may have a deadline set
+    };
+
+    struct InputDevice {
+        int fd;
+        std::string name;
+        bool isVirtual;  // one of our own uinput devices, never fed to rules or hotstrings
+        bool grabbed;    // guarded by m_remapMutex
+        std::shared_ptr<KeyDebouncer> debounce;  // listener thread only
+        MouseDelta motion;                        // current report, listener thread only
+        bool hasMotion;
+    };
+    std::vector<InputDevice> m_inputDevices;
+
+    std::mutex m_debounceMutex;
+    std::shared_ptr<const DebounceConfig> m_debounceConfig;
+    std::atomic<uint32_t> m_bounceCounts[KEY_CNT] = {};
+    uint64_t m_nextDebounceNs = 0;  // earliest pending deadline, listener thread only
+
+    struct RemapStageEntry {
+        int id = 0;
+        std::string name;
+        RemapStage stage;
+        LatencyRecorder timing;
+    };
+    using RemapPipeline = std::vector<std::shared_ptr<RemapStageEntry>>;
+
+    std::mutex m_remapMutex;
+    std::shared_ptr<const RemapPipeline> m_remapPipeline;
+    int m_nextRemapStageId = 1;
+    LatencyRecorder m_remapLatency;
+
+    // ---------- Recording ----------
+    // Single-producer single-consumer ring; push() and pop() never block
+    template <typename T, size_t Capacity>
+    struct SpscRing {
+        static_assert((Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+        std::unique_ptr<T[]> slots{new T[Capacity]};
+        alignas(64) std::atomic<size_t> head{0};  // written by the producer
+        alignas(64) std::atomic<size_t> tail{0};  // written by the consumer
+
+        bool push(const T& item) {
+            size_t h = head.load(std::memory_order_relaxed);
+            if (h - tail.load(std::memory_order_acquire) == Capacity) return false;
+            slots[h & (Capacity - 1)] = item;
+            head.store(h + 1, std::memory_order_release);
+            return true;
+        }
+
+        size_t pop(T* out, size_t max) {
+            size_t t = tail.load(std::memory_order_relaxed);
+            size_t n = std::min(max, head.load(std::memory_order_acquire) - t);
+            for (size_t i = 0; i < n; ++i) out[i] = slots[(t + i) & (Capacity - 1)];
+            tail.store(t + n, std::memory_order_release);
+            return n;
+        }
+    };
+
+    static constexpr char kRecordingMagic[8] = {'I', 'N', 'P', 'C', 'R', 'E', 'C', '1'};
+    static constexpr size_t kRecordChunkBytes = 4u << 20;
+
+    struct RecordingHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t recordSize;
+        uint64_t recordCount;  // 0 until the recording is finished
+        uint64_t startNs;
+    };
+
+    struct Recorder {
+        unsigned int filter = RecordAll;
+        int fd = -1;
+        uint8_t* map = nullptr;
+        size_t mapSize = 0;
+        std::atomic<uint64_t> written{0};  // stored by the writer thread only
+        SpscRing<RecordedEvent, (1u << 16)> ring;
+        std::atomic<uint64_t> accepted{0};
+        std::atomic<uint64_t> dropped{0};
+        std::atomic<bool> stopping{false};
+        std::thread writer;
+    };
+
+    // m_recorder owns the running recorder and is guarded by m_recordMutex.
+    // The listener reads m_liveRecorder instead, flagging m_recorderInUse
+    // around each use so stopRecording() can wait it out without a lock.
+    std::mutex m_recordMutex;
+    std::shared_ptr<Recorder> m_recorder;
+    std::atomic<Recorder*> m_liveRecorder{nullptr};
+    std::atomic<bool> m_recorderInUse{false};
+
+    // Flight recorder region: header, then `capacity` slots. Slot n of the
+    // sequence lives at n % capacity; its seq is 2n+1 while being written
+    // and 2n+2 once complete, so readers can drop torn or stale slots.
+    static constexpr char kFlightMagic[8] = {'I', 'N', 'P', 'C', 'F', 'L', 'T', '1'};
+
+    struct FlightHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t slotSize;
+        uint64_t capacity;  // power of two
+        uint64_t pid;
+        alignas(64) std::atomic<uint64_t> head;  // next sequence number
+    };
+
+    struct FlightSlot {
+        std::atomic<uint64_t> seq;
+        uint64_t timeNs;
+        uint16_t type;
+        uint16_t code;
+        int32_t value;
+        uint32_t source;
+        uint32_t reserved;
+    };
+
+    std::mutex m_flightMutex;
+    FlightHeader* m_flightMap = nullptr;
+    size_t m_flightMapSize = 0;
+    std::string m_flightPath;
+    std::atomic<FlightHeader*> m_flightRing{nullptr};  // null while stopped
+
+    // Hot path of the listener and every uinput write
+    void flightLog(const struct input_event* events, size_t count, FlightSource source) {
+        FlightHeader* ring = m_flightRing.load(std::memory_order_acquire);
+        if (!ring || count == 0) return;
+        FlightSlot* slots = reinterpret_cast<FlightSlot*>(ring + 1);
+        uint64_t mask = ring->capacity - 1;
+        uint64_t n = ring->head.fetch_add(count, std::memory_order_relaxed);
+        uint64_t injectedNs = source == FlightSource::Injected ? monotonicNowNs() : 0;
+        for (size_t i = 0; i < count; ++i, ++n) {
+            FlightSlot& slot = slots[n & mask];
+            slot.seq.store(2 * n + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            slot.timeNs = injectedNs ? injectedNs : eventTimeNs(events[i]);
+            slot.type = events[i].type;
+            slot.code = events[i].code;
+            slot.value = events[i].value;
+            slot.source = static_cast<uint32_t>(source);
+            slot.seq.store(2 * n + 2, std::memory_order_release);
+        }
+    }
+
+    // Called once no thread can log any more. A clean exit removes the
+    // file; after a crash it stays behind for dumpFlightRecorder().
+    void closeFlightRecorder() {
+        std::lock_guard<std::mutex> lock(m_flightMutex);
+        m_flightRing.store(nullptr, std::memory_order_release);
+        if (!m_flightMap) return;
+        munmap(m_flightMap, m_flightMapSize);
+        unlink(m_flightPath.c_str());
+        m_flightMap = nullptr;
+        m_flightPath.clear();
+    }
+
+    static unsigned int recordClass(const struct input_event& ev) {
+        if (ev.type == EV_KEY) return ev.code < BTN_MISC ? RecordKeys : RecordButtons;
+        if (ev.type != EV_REL) return 0;
+        if (ev.code == REL_X || ev.code == REL_Y) return RecordMotion;
+        if (ev.code == REL_WHEEL || ev.code == REL_HWHEEL ||
+            ev.code == REL_WHEEL_HI_RES || ev.code == REL_HWHEEL_HI_RES) return RecordWheel;
+        return 0;
+    }
+
+    // Listener side: copy matching events into the ring, never waiting
+    void recordEvents(Recorder& recorder, const struct input_event* events, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            if (!(recordClass(events[i]) & recorder.filter)) continue;
+            RecordedEvent rec;
+            rec.timeNs = eventTimeNs(events[i]);
+            rec.type = events[i].type;
+            rec.code = events[i].code;
+            rec.value = events[i].value;
+            if (recorder.ring.push(rec)) {
+                recorder.accepted.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                recorder.dropped.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Extend the file and its mapping to at least `size` bytes
+    static bool growRecording(Recorder& recorder, size_t size) {
+        if (ftruncate(recorder.fd, size) < 0) {
+            std::cerr << "Failed to grow recording: " << strerror(errno) << std::endl;
+            return false;
+        }
+        void* map = recorder.map
+            ? mremap(recorder.map, recorder.mapSize, size, MREMAP_MAYMOVE)
+            : mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, recorder.fd, 0);
+        if (map == MAP_FAILED) {
+            std::cerr << "Failed to map recording: " << strerror(errno) << std::endl;
+            return false;
+        }
+        recorder.map = static_cast<uint8_t*>(map);
+        recorder.mapSize = size;
+        return true;
+    }
+
+    // Drain the ring into the mapped file until stopRecording()
+    void recordingWriterLoop(Recorder& recorder) {
+        prepareThread();
+        RecordedEvent chunk[1024];
+        while (true) {
+            bool stopping = recorder.stopping.load();
+            size_t n;
+            while ((n = recorder.ring.pop(chunk, 1024)) > 0) {
+                uint64_t written = recorder.written.load(std::memory_order_relaxed);
+                size_t end = sizeof(RecordingHeader) + (written + n) * sizeof(RecordedEvent);
+                if (end > recorder.mapSize) {
+                    // Grow geometrically so remaps stay rare on long recordings
+                    size_t grow = std::min<size_t>(recorder.mapSize, 64 * kRecordChunkBytes);
+                    if (!growRecording(recorder, std::max(end, recorder.mapSize + grow))) {
+                        recorder.dropped.fetch_add(n, std::memory_order_relaxed);
+                        continue;
+                    }
+                }
+                memcpy(recorder.map + sizeof(RecordingHeader) + written * sizeof(RecordedEvent),
+                       chunk, n * sizeof(RecordedEvent));
+                recorder.written.store(written + n, std::memory_order_relaxed);
+            }
+            if (stopping) break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+    }
+
+    static RecordingStats recordingStats(const Recorder& recorder) {
+        RecordingStats stats;
+        stats.events = recorder.accepted.load(std::memory_order_relaxed);
+        stats.dropped = recorder.dropped.load(std::memory_order_relaxed);
+        // What is in the file so far, not counting events still in the ring
+        stats.bytes = sizeof(RecordingHeader) +
+                      recorder.written.load(std::memory_order_relaxed) * sizeof(RecordedEvent);
+        return stats;
+    }
+
+    // Seal the header and trim the preallocated tail
+    static void finishRecording(Recorder& recorder) {
+        uint64_t written = recorder.written.load();
+        size_t size = sizeof(RecordingHeader) + written * sizeof(RecordedEvent);
+        if (recorder.map) {
+            reinterpret_cast<RecordingHeader*>(recorder.map)->recordCount = written;
+            msync(recorder.map, size, MS_SYNC);
+            munmap(recorder.map, recorder.mapSize);
+            recorder.map = nullptr;
+        }
+        if (ftruncate(recorder.fd, size) < 0) {
+            std::cerr << "Failed to trim recording: " << strerror(errno) << std::endl;
+        }
+        close(recorder.fd);
+        recorder.fd = -1;
+    }
+
+    // Absolute pointer position of a recorded motion report
+    struct PathPoint {
+        uint64_t timeNs;
+        int64_t x, y;
+    };
+
+    // Ramer-Douglas-Peucker over `path`, then resampling of the kept
+    // vertices; appends REL_X/REL_Y events taking the pointer from the
+    // first point to exactly the last one
+    static void emitSimplifiedPath(const std::vector<PathPoint>& path, double maxErrorPx,
+                                   int rateHz, std::vector<RecordedEvent>& out) {
+        if (path.size() < 2) return;
+        
+        std::vector<bool> keep(path.size(), false);
+        keep.front() = keep.back() = true;
+        std::vector<std::pair<size_t, size_t>> spans = {{0, path.size() - 1}};
+        while (!spans.empty()) {
+            auto span = spans.back();
+            spans.pop_back();
+            const PathPoint& a = path[span.first];
+            const PathPoint& b = path[span.second];
+            double maxDist = -1.0;
+            size_t split = 0;
+            for (size_t k = span.first + 1; k < span.second; ++k) {
+                // Distance to where the chord puts the pointer at the same time
+                double f = b.timeNs > a.timeNs
+                    ? static_cast<double>(path[k].timeNs - a.timeNs) / (b.timeNs - a.timeNs) : 1.0;
+                double dx = a.x + f * (b.x - a.x) - path[k].x;
+                double dy = a.y + f * (b.y - a.y) - path[k].y;
+                double dist = std::sqrt(dx * dx + dy * dy);
+                if (dist > maxDist) {
+                    maxDist = dist;
+                    split = k;
+                }
+            }
+            if (maxDist > maxErrorPx) {
+                keep[split] = true;
+                spans.push_back({span.first, split});
+                spans.push_back({split, span.second});
+            }
+        }
+        std::vector<size_t> vertices;
+        for (size_t i = 0; i < path.size(); ++i) {
+            if (keep[i]) vertices.push_back(i);
+        }
+        
+        int64_t sentX = path.front().x, sentY = path.front().y;
+        auto emit = [&](uint64_t timeNs, int64_t px, int64_t py) {
+            if (px != sentX) out.push_back({timeNs, EV_REL, REL_X, static_cast<int32_t>(px - sentX)});
+            if (py != sentY) out.push_back({timeNs, EV_REL, REL_Y, static_cast<int32_t>(py - sentY)});
+            sentX = px;
+            sentY = py;
+        };
+        const PathPoint& last = path[vertices.back()];
+        if (rateHz > 0) {
+            uint64_t period = std::max<uint64_t>(1, 1000000000ULL / rateHz);
+            size_t seg = 0;
+            for (uint64_t t = path.front().timeNs + period; t < last.timeNs; t += period) {
+                while (path[vertices[seg + 1]].timeNs < t) seg++;
+                const PathPoint& a = path[vertices[seg]];
+                const PathPoint& b = path[vertices[seg + 1]];
+                double f = b.timeNs > a.timeNs
+                    ? static_cast<double>(t - a.timeNs) / (b.timeNs - a.timeNs) : 1.0;
+                emit(t, std::llround(a.x + f * (b.x - a.x)), std::llround(a.y + f * (b.y - a.y)));
+            }
+        } else {
+            for (size_t i = 1; i + 1 < vertices.size(); ++i) {
+                emit(path[vertices[i]].timeNs, path[vertices[i]].x, path[vertices[i]].y);
+            }
+        }
+        emit(last.timeNs, last.x, last.y);
+    }
+
+    struct KeyMapping {
+        unsigned int keyCode;
+        bool needShift;
+    };
+
+    // Events collected for a single write() to the uinput device. Every
+    // report ends with SYN_REPORT, so several reports can share one syscall.
+    struct EventBatch {
+        std::vector<struct input_event> events;
+
+        void add(int type, int code, int val) {
+            struct input_event ie;
+            memset(&ie, 0, sizeof(ie));
+            ie.type = type;
+            ie.code = code;
+            ie.value = val;
+            events.push_back(ie);
+        }
+        void sync() { add(EV_SYN, SYN_REPORT, 0); }
+        // Add relative motion to the open report, merging with motion
+        // already queued on the same axis
+        void rel(int code, int val) {
+            for (size_t i = events.size(); i-- > 0 && events[i].type != EV_SYN;) {
+                if (events[i].type == EV_REL && events[i].code == code) {
+                    events[i].value += val;
+                    return;
+                }
+            }
+            add(EV_REL, code, val);
+        }
+        bool reportOpen() const { return !events.empty() && events.back().type != EV_SYN; }
+        void key(int code, int val) { add(EV_KEY, code, val); sync(); }
+        void append(const struct input_event* ev, size_t count) {
+            events.insert(events.end(), ev, ev + count);
+        }
+        bool empty() const { return events.empty(); }
+        void clear() { events.clear(); }
+    };
+
+    // ---------- Hotstrings ----------
+    struct Hotstring {
+        int id = 0;
+        std::string trigger;
+        std::string replacement;
+        bool erase = true;
+        std::function<void()> callback;
+    };
+
+    // Aho-Corasick automaton over all registered triggers. Every state has a
+    // full transition row, so the listener advances it with one table lookup
+    // per typed character no matter how many triggers are registered.
+    struct HotstringAutomaton {
+        static constexpr int kAlphabet = 97;  // printable ASCII, '\t', '\n'
+
+        std::vector<int> next;    // state * kAlphabet + symbol -> state
+        std::vector<int> output;  // state -> index into hotstrings, or -1
+        std::vector<Hotstring> hotstrings;
+
+        static int symbol(char c) {
+            if (c >= ' ' && c <= '~') return c - ' ';
+            if (c == '\t') return 95;
+            if (c == '\n') return 96;
+            return -1;
+        }
+
+        explicit HotstringAutomaton(std::vector<Hotstring> list)
+            : hotstrings(std::move(list)) {
+            next.assign(kAlphabet, -1);
+            output.assign(1, -1);
+
+            // Trie of all triggers; the first registration of a trigger wins
+            for (size_t i = 0; i < hotstrings.size(); ++i) {
+                int state = 0;
+                for (char c : hotstrings[i].trigger) {
+                    size_t slot = static_cast<size_t>(state) * kAlphabet + symbol(c);
+                    if (next[slot] < 0) {
+                        next[slot] = static_cast<int>(output.size());
+                        output.push_back(-1);
+                        next.resize(output.size() * kAlphabet, -1);
+                    }
+                    state = next[slot];
+                }
+                if (output[state] < 0) output[state] = static_cast<int>(i);
+            }
+
+            // Breadth-first pass turning the trie into a full DFA. A state
+            // without its own match inherits the match of its failure link,
+            // which is the longest trigger ending at that point.
+            std::vector<int> fail(output.size(), 0);
+            std::vector<int> queue;
+            for (int sym = 0; sym < kAlphabet; ++sym) {
+                if (next[sym] < 0) {
+                    next[sym] = 0;
+                } else {
+                    queue.push_back(next[sym]);
+                }
+            }
+            for (size_t head = 0; head < queue.size(); ++head) {
+                int state = queue[head];
+                if (output[state] < 0) output[state] = output[fail[state]];
+                for (int sym = 0; sym < kAlphabet; ++sym) {
+                    size_t slot = static_cast<size_t>(state) * kAlphabet + sym;
+                    int viaFail = next[static_cast<size_t>(fail[state]) * kAlphabet + sym];
+                    if (next[slot] < 0) {
+                        next[slot] = viaFail;
+                    } else {
+                        fail[next[slot]] = viaFail;
+                        queue.push_back(next[slot]);
+                    }
+                }
+            }
+        }
+    };
+
+    std::mutex m_hotstringMutex;
+    std::vector<Hotstring> m_hotstrings;
+    std::shared_ptr<const HotstringAutomaton> m_hotstringAutomaton;
+    int m_nextHotstringId = 1;
+
+    // Matcher state, only touched by the listener thread
+    std::shared_ptr<const HotstringAutomaton> m_hsAutomaton;
+    int m_hsState = 0;
+    bool m_hsShift[2] = {false, false};
+    int m_hsModifiers = 0;  // Ctrl/Alt/Meta keys currently down
+    int m_hsPending = -1;   // matched while Shift was down, typed once it is up
+
+    int registerHotstring(Hotstring hs) {
+        if (hs.trigger.empty()) {
+            std::cerr << "Hotstring trigger must not be empty" << std::endl;
+            return -1;
+        }
+        for (char c : hs.trigger) {
+            if (HotstringAutomaton::symbol(c) < 0 || !linuxCharMap().count(c)) {
+                std::cerr << "Character '" << c << "' cannot be used in a hotstring" << std::endl;
+                return -1;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(m_hotstringMutex);
+        hs.id = m_nextHotstringId++;
+        m_hotstrings.push_back(std::move(hs));
+        m_hotstringAutomaton = std::make_shared<HotstringAutomaton>(m_hotstrings);
+        return m_hotstrings.back().id;
+    }
+
+    // Advance the hotstring matcher by one key event from a physical device
+    void feedHotstrings(const struct input_event& ev) {
+        switch (ev.code) {
+            case KEY_LEFTSHIFT:  m_hsShift[0] = (ev.value != 0); typePendingHotstring(); return;
+            case KEY_RIGHTSHIFT: m_hsShift[1] = (ev.value != 0); typePendingHotstring(); return;
+            case KEY_LEFTCTRL: case KEY_RIGHTCTRL:
+            case KEY_LEFTALT: case KEY_RIGHTALT:
+            case KEY_LEFTMETA: case KEY_RIGHTMETA:
+                if (ev.value == 1) m_hsModifiers++;
+                else if (ev.value == 0 && m_hsModifiers > 0) m_hsModifiers--;
+                return;
+        }
+        if (ev.value == 0) return;  // Only presses and autorepeat type characters
+        m_hsPending = -1;  // typing on makes the erase count of a pending one wrong
+
+        std::shared_ptr<const HotstringAutomaton> automaton;
+        {
+            std::lock_guard<std::mutex> lock(m_hotstringMutex);
+            automaton = m_hotstringAutomaton;
+        }
+        if (automaton != m_hsAutomaton) {
+            m_hsAutomaton = automaton;
+            m_hsState = 0;
+        }
+        if (!automaton) return;
+
+        // Shortcuts and non-character keys (arrows, Backspace, ...) break
+        // the typed sequence
+        char c = m_hsModifiers ? 0 : decodeCharLinux(ev.code, m_hsShift[0] || m_hsShift[1]);
+        int sym = HotstringAutomaton::symbol(c);
+        if (c == 0 || sym < 0) {
+            m_hsState = 0;
+            return;
+        }
+
+        m_hsState = automaton->next[static_cast<size_t>(m_hsState) * HotstringAutomaton::kAlphabet + sym];
+        int match = automaton->output[m_hsState];
+        if (match < 0) return;
+
+        m_hsState = 0;
+        const Hotstring& hs = automaton->hotstrings[match];
+        if (hs.callback) {
+            hs.callback();
+            return;
+        }
+        // The user's Shift would change the replacement (and may be held on
+        // a device we cannot release it for), so wait until it is up
+        m_hsPending = match;
+        typePendingHotstring();
+    }
+
+    void typePendingHotstring() {
+        if (m_hsPending < 0 || m_hsShift[0] || m_hsShift[1] || !m_hsAutomaton) return;
+        const Hotstring& hs = m_hsAutomaton->hotstrings[m_hsPending];
+        m_hsPending = -1;
+        
+        EventBatch batch;
+        if (hs.erase) {
+            for (size_t i = 0; i < hs.trigger.size(); ++i) {
+                batch.key(KEY_BACKSPACE, 1);
+                batch.key(KEY_BACKSPACE, 0);
+            }
+        }
+        appendTextLinux(batch, hs.replacement);
+        emitBatch(batch);
+    }
+    
+    // ---------- Listener rules ----------
+    struct KeyRule {
+        int id = 0;
+        unsigned int trigger = 0;                            // VK code
+        KeyEdge edge = KeyEdge::Down;
+        std::vector<std::pair<unsigned int, int>> output;    // evdev code, value
+        std::function<void(Key, bool)> callback;
+    };
+
+    // Rules bucketed by trigger code and edge so the listener finds the
+    // matching ones with a direct index
+    struct RuleTable {
+        std::vector<KeyRule> byTrigger[256][2];  // [vk][0 = up, 1 = down]
+    };
+
+    using MotionSubscribers = std::vector<std::pair<int, std::function<void(const MouseDelta&)>>>;
+
+    std::mutex m_ruleMutex;
+    std::vector<KeyRule> m_rules;
+    std::shared_ptr<const RuleTable> m_ruleTable;
+    std::shared_ptr<const MotionSubscribers> m_motionSubscribers;
+    int m_nextRuleId = 1;
+    LatencyRecorder m_ruleLatency;
+
+    // REL_X, REL_Y, REL_WHEEL, REL_HWHEEL totals from physical devices
+    std::atomic<int64_t> m_mouseMotion[4] = {};
+
+    // Listener-thread output collected during one pass over the devices
+    EventBatch m_listenerBatch;
+    std::atomic<std::thread::id> m_eventLoopThread{};  // threaded listener
+    std::vector<uint64_t> m_pendingTriggerNs;
+    std::vector<uint64_t> m_pendingRemapNs;
+
+    int registerRule(KeyRule rule) {
+        if (rule.trigger >= 256) {
+            std::cerr << "Rule trigger key out of range" << std::endl;
+            return -1;
+        }
+        std::lock_guard<std::mutex> lock(m_ruleMutex);
+        rule.id = m_nextRuleId++;
+        m_rules.push_back(std::move(rule));
+        rebuildRuleTable();
+        return m_rules.back().id;
+    }
+
+    // Caller holds m_ruleMutex
+    void rebuildRuleTable() {
+        if (m_rules.empty()) {
+            m_ruleTable.reset();
+            return;
+        }
+        auto table = std::make_shared<RuleTable>();
+        for (const KeyRule& rule : m_rules) {
+            if (rule.edge != KeyEdge::Up) table->byTrigger[rule.trigger][1].push_back(rule);
+            if (rule.edge != KeyEdge::Down) table->byTrigger[rule.trigger][0].push_back(rule);
+        }
+        m_ruleTable = table;
+    }
+
+    static uint64_t monotonicNowNs() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+    }
+
+    static uint64_t eventTimeNs(const struct input_event& ev) {
+        return static_cast<uint64_t>(ev.input_event_sec) * 1000000000ULL +
+               static_cast<uint64_t>(ev.input_event_usec) * 1000ULL;
+    }
+
+    // Run the rules bound to a key transition; outputs join the listener batch
+    void dispatchRules(const RuleTable& table, unsigned int winCode, const struct input_event& ev) {
+        if (winCode >= 256 || ev.value == 2) return;  // autorepeat is not an edge
+        bool down = (ev.value != 0);
+        const auto& rules = table.byTrigger[winCode][down ? 1 : 0];
+        if (rules.empty()) return;
+
+        bool queued = false;
+        for (const KeyRule& rule : rules) {
+            if (rule.callback) {
+                rule.callback(static_cast<Key>(winCode), down);
+                continue;
+            }
+            for (const auto& out : rule.output) {
+                m_listenerBatch.key(out.first, out.second);
+                queued = true;
+            }
+        }
+        if (queued) m_pendingTriggerNs.push_back(eventTimeNs(ev));
+    }
+
+    bool initLinux() {
+        // Initialize uinput for output
+        m_uinputFd = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
+        if (m_uinputFd < 0) {
+            std::cout << "Failed to open /dev/uinput. Run with sudo!" << std::endl;
+            return true;
+        }
+        
+        struct uinput_setup setup;
+        memset(&setup, 0, sizeof(setup));
+        strcpy(setup.name, "CrossInput Virtual Device");
+        setup.id.bustype = BUS_USB;
+        setup.id.vendor = 0x1234;
+        setup.id.product = 0x5678;
+        setup.id.version = 1;
+        
+        // Keys, mouse buttons and mouse movement
+        DeviceCaps& caps = m_outputCaps;
+        caps = DeviceCaps();
+        for (int i = 0; i < 256; ++i) caps.set(caps.keys, i);
+        for (int button : {BTN_LEFT, BTN_RIGHT, BTN_MIDDLE, BTN_SIDE, BTN_EXTRA}) {
+            caps.set(caps.keys, button);
+        }
+        for (int axis : {REL_X, REL_Y, REL_WHEEL, REL_HWHEEL, REL_WHEEL_HI_RES, REL_HWHEEL_HI_RES}) {
+            caps.set(caps.rels, axis);
+        }
+        // Plus whatever else the keyboards and mice present could send, so
+        // grabbing them loses nothing
+        addReemittableCaps(caps);
+        ioctl(m_uinputFd, UI_SET_EVBIT, EV_KEY);
+        for (int code = 0; code <= KEY_MAX; ++code) {
+            if (caps.has(caps.keys, code)) ioctl(m_uinputFd, UI_SET_KEYBIT, code);
+        }
+        ioctl(m_uinputFd, UI_SET_EVBIT, EV_REL);
+        for (int code = 0; code <= REL_MAX; ++code) {
+            if (caps.has(caps.rels, code)) ioctl(m_uinputFd, UI_SET_RELBIT, code);
+        }
+        if (m_options.kernelRepeat) {
+            ioctl(m_uinputFd, UI_SET_EVBIT, EV_REP);
+        }
+        
+        // Create device
+        ioctl(m_uinputFd, UI_DEV_SETUP, &setup);
+        ioctl(m_uinputFd, UI_DEV_CREATE);
+        
+        if (!m_options.monitors.empty()) {
+            createAbsoluteDevice();
+        }
+        
+        // Open input devices up front so they can be grabbed right after init
+        openInputDevices();
+        
+        // Start input listener thread, or the reactor that replaces both it
+        // and the scheduler thread
+        m_running = true;
+        if (m_options.mode == Mode::Manual) {
+            if (!openReactor()) {
+                m_running = false;
+                cleanupLinux();
+                return false;
+            }
+        } else if (m_options.mode == Mode::Reactor && openReactor()) {
+            m_listenerThread = std::thread([this]() { reactorLoop(); });
+        } else {
+            m_listenerThread = std::thread([this]() { linuxEventLoop(); });
+        }
+        
+        m_initialized = true;
+        if (m_listenerThread.joinable()) {
+            bool reactor = m_reactorFd >= 0;
+            if (!configureThread(m_listenerThread, reactor ? "inpctrl-reactor" : "inpctrl-listen",
+                                 reactor ? m_options.reactorCpu : -1)) {
+                cleanup();
+                return false;
+            }
+        }
+        std::cout << "Linux input initialized" << std::endl;
+        return true;
+    }
+    
+    // Second virtual device reporting ABS_X/ABS_Y over the desktop bounding
+    // box, so one report can place the pointer anywhere regardless of
+    // pointer acceleration
+    // Event types, keys and relative axes a device reports (EVIOCGBIT)
+    struct DeviceCaps {
+        uint8_t types[EV_MAX / 8 + 1] = {};
+        uint8_t keys[KEY_MAX / 8 + 1] = {};
+        uint8_t rels[REL_MAX / 8 + 1] = {};
+
+        static bool has(const uint8_t* bits, int code) { return bits[code / 8] & (1 << (code % 8)); }
+        static void set(uint8_t* bits, int code) { bits[code / 8] |= static_cast<uint8_t>(1 << (code % 8)); }
+
+        bool read(int fd) {
+            return ioctl(fd, EVIOCGBIT(0, sizeof(types)), types) >= 0 &&
+                   ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(keys)), keys) >= 0 &&
+                   ioctl(fd, EVIOCGBIT(EV_REL, sizeof(rels)), rels) >= 0;
+        }
+    };
+    DeviceCaps m_outputCaps;  // what the virtual device can re-emit
+
+    // Why the virtual device cannot stand in for a grabbed device, or empty.
+    // Scan codes, LEDs, autorepeat and force feedback may be left behind.
+    std::string missingCaps(int fd) const {
+        DeviceCaps caps;
+        if (!caps.read(fd)) return "capabilities";
+        for (int type = 0; type <= EV_MAX; ++type) {
+            if (!caps.has(caps.types, type)) continue;
+            if (type == EV_SYN || type == EV_KEY || type == EV_REL || type == EV_MSC ||
+                type == EV_LED || type == EV_REP || type == EV_FF) continue;
+            return type == EV_ABS ? "absolute axes" : "event type " + std::to_string(type);
+        }
+        for (int code = 0; code <= KEY_MAX; ++code) {
+            if (caps.has(caps.keys, code) && !m_outputCaps.has(m_outputCaps.keys, code)) {
+                return "key " + std::to_string(code);
+            }
+        }
+        for (int code = 0; code <= REL_MAX; ++code) {
+            if (caps.has(caps.rels, code) && !m_outputCaps.has(m_outputCaps.rels, code)) {
+                return "relative axis " + std::to_string(code);
+            }
+        }
+        return "";
+    }
+
+    // Add the keys and relative axes of every physical device the virtual
+    // device could fully stand in for, i.e. those without absolute axes
+    void addReemittableCaps(DeviceCaps& out) {
+        DIR* dir = opendir("/dev/input");
+        if (!dir) return;
+        struct dirent* ent;
+        while ((ent = readdir(dir)) != nullptr) {
+            if (strncmp(ent->d_name, "event", 5) != 0) continue;
+            std::string path = "/dev/input/" + std::string(ent->d_name);
+            int fd = open(path.c_str(), O_RDONLY | O_NONBLOCK);
+            if (fd < 0) continue;
+            char name[256] = {0};
+            ioctl(fd, EVIOCGNAME(sizeof(name) - 1), name);
+            DeviceCaps caps;
+            bool usable = strncmp(name, "CrossInput ", 11) != 0 && caps.read(fd) &&
+                          !caps.has(caps.types, EV_ABS) && !caps.has(caps.types, EV_SW);
+            close(fd);
+            if (!usable) continue;
+            for (size_t i = 0; i < sizeof(out.keys); ++i) out.keys[i] |= caps.keys[i];
+            for (size_t i = 0; i < sizeof(out.rels); ++i) out.rels[i] |= caps.rels[i];
+        }
+        closedir(dir);
+    }
+
+    bool createAbsoluteDevice() {
+        int minX, minY, maxX, maxY;
+        if (!desktopBounds(minX, minY, maxX, maxY)) {
+            std::cerr << "Invalid monitor layout, absolute pointer disabled" << std::endl;
+            return false;
+        }
+        
+        m_absFd = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
+        if (m_absFd < 0) {
+            std::cerr << "Failed to open /dev/uinput for the absolute pointer" << std::endl;
+            return false;
+        }
+        
+        struct uinput_setup setup;
+        memset(&setup, 0, sizeof(setup));
+        strcpy(setup.name, "CrossInput Absolute Pointer");
+        setup.id.bustype = BUS_USB;
+        setup.id.vendor = 0x1234;
+        setup.id.product = 0x5679;
+        setup.id.version = 1;
+        
+        // Buttons make the device classify as an absolute mouse rather
+        // than a touchscreen or tablet
+        ioctl(m_absFd, UI_SET_EVBIT, EV_KEY);
+        ioctl(m_absFd, UI_SET_KEYBIT, BTN_LEFT);
+        ioctl(m_absFd, UI_SET_KEYBIT, BTN_RIGHT);
+        ioctl(m_absFd, UI_SET_KEYBIT, BTN_MIDDLE);
+        
+        ioctl(m_absFd, UI_SET_EVBIT, EV_ABS);
+        struct uinput_abs_setup abs;
+        memset(&abs, 0, sizeof(abs));
+        abs.code = ABS_X;
+        abs.absinfo.minimum = minX;
+        abs.absinfo.maximum = maxX;
+        ioctl(m_absFd, UI_ABS_SETUP, &abs);
+        abs.code = ABS_Y;
+        abs.absinfo.minimum = minY;
+        abs.absinfo.maximum = maxY;
+        ioctl(m_absFd, UI_ABS_SETUP, &abs);
+        
+        ioctl(m_absFd, UI_DEV_SETUP, &setup);
+        ioctl(m_absFd, UI_DEV_CREATE);
+        return true;
+    }
+
+    bool moveMouseToLinux(int x, int y) {
+        if (m_absFd < 0) {
+            std::cerr << "Absolute pointer unavailable, pass monitors to init()" << std::endl;
+            return false;
+        }
+        
+        int minX, minY, maxX, maxY;
+        desktopBounds(minX, minY, maxX, maxY);
+        
+        std::lock_guard<std::mutex> lock(m_absMutex);
+        EventBatch batch;
+        // The kernel drops an axis value equal to its last one, so an axis
+        // returning there after the mouse moved needs a one pixel nudge,
+        // kept inside the desktop
+        if (x == m_absLastX) batch.add(EV_ABS, ABS_X, x > minX ? x - 1 : x + 1);
+        if (y == m_absLastY) batch.add(EV_ABS, ABS_Y, y > minY ? y - 1 : y + 1);
+        if (batch.reportOpen()) batch.sync();
+        batch.add(EV_ABS, ABS_X, x);
+        batch.add(EV_ABS, ABS_Y, y);
+        batch.sync();
+        m_absLastX = x;
+        m_absLastY = y;
+        
+        flightLog(batch.events.data(), batch.events.size(), FlightSource::Injected);
+        ssize_t size = batch.events.size() * sizeof(struct input_event);
+        return write(m_absFd, batch.events.data(), size) == size;
+    }
+
+    void cleanupLinux() {
+        stopRecording();
+        
+        closeReactor();
+        
+        closeFlightRecorder();
+        
+        if (m_uinputFd >= 0) {
+            ioctl(m_uinputFd, UI_DEV_DESTROY);
+            close(m_uinputFd);
+            m_uinputFd = -1;
+        }
+        if (m_absFd >= 0) {
+            ioctl(m_absFd, UI_DEV_DESTROY);
+            close(m_absFd);
+            m_absFd = -1;
+        }
+        
+        for (const InputDevice& dev : m_inputDevices) {
+            close(dev.fd);
+        }
+        m_inputDevices.clear();
+    }
+    
+    void openInputDevices() {
+        DIR* dir = opendir("/dev/input");
+        if (!dir) return;
+        
+        struct dirent* ent;
+        while ((ent = readdir(dir)) != nullptr) {
+            if (strncmp(ent->d_name, "event", 5) == 0) {
+                std::string path = "/dev/input/" + std::string(ent->d_name);
+                int fd = open(path.c_str(), O_RDONLY | O_NONBLOCK);
+                if (fd >= 0) {
+                    // Kernel timestamps on the same clock as monotonicNowNs()
+                    int clockId = CLOCK_MONOTONIC;
+                    ioctl(fd, EVIOCSCLOCKID, &clockId);
+
+                    char name[256] = {0};
+                    ioctl(fd, EVIOCGNAME(sizeof(name) - 1), name);
+                    InputDevice dev;
+                    dev.fd = fd;
+                    dev.name = name;
+                    dev.isVirtual = (dev.name.compare(0, 11, "CrossInput ") == 0);
+                    dev.grabbed = false;
+                    dev.hasMotion = false;
+                    m_inputDevices.push_back(dev);
+                }
+            }
+        }
+        closedir(dir);
+    }
+
+    void linuxEventLoop() {
+        prepareThread();
+        m_eventLoopThread = std::this_thread::get_id();
+        std::vector<struct pollfd> pfds;
+        for (const InputDevice& dev : m_inputDevices) {
+            pfds.push_back({dev.fd, POLLIN, 0});
+        }
+        
+        struct input_event events[64];
+        while (m_running) {
+            int ready = spinThenWait(m_nextDebounceNs, [&](bool block) {
+                // The timeout bounds how long cleanup() waits for us, or wakes
+                // us when the next debounce window closes
+                struct timespec timeout = {0, block ? 50 * 1000000 : 0};
+                if (block && m_nextDebounceNs) {
+                    uint64_t now = monotonicNowNs();
+                    uint64_t wait = m_nextDebounceNs > now ? m_nextDebounceNs - now : 0;
+                    if (wait < 50000000ULL) timeout.tv_nsec = static_cast<long>(wait);
+                }
+                return ppoll(pfds.data(), pfds.size(), &timeout, nullptr);
+            });
+            if (ready <= 0) {
+                expireDebounce(monotonicNowNs());
+                flushListenerBatch();
+                continue;
+            }
+            
+            for (size_t i = 0; i < pfds.size(); ++i) {
+                if (pfds[i].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+                    pfds[i].fd = -1;  // Device went away, stop polling it
+                    continue;
+                }
+                if (!(pfds[i].revents & POLLIN)) continue;
+                
+                ssize_t n = read(pfds[i].fd, events, sizeof(events));
+                if (n > 0) {
+                    processEvents(m_inputDevices[i], events, n / sizeof(struct input_event));
+                }
+            }
+            expireDebounce(monotonicNowNs());
+            flushListenerBatch();
+        }
+        m_eventLoopThread = std::thread::id();
+    }
+
+    // ==================== REACTOR ====================
+    // One epoll set holds the input devices, a timerfd armed for the next
+    // scheduler or debounce deadline and an eventfd that wakes the loop for
+    // posted commands and new tasks. Writes to uinput never block, so that
+    // fd needs no readiness. Each pass handles whatever is ready, runs due
+    // tasks and commands, then flushes all output with one write.
+    static constexpr uint64_t kReactorTimer = 0;
+    static constexpr uint64_t kReactorWake = 1;
+    static constexpr uint64_t kReactorDevices = 2;  // + index into m_inputDevices
+    
+    int m_reactorFd = -1;
+    int m_reactorTimerFd = -1;
+    int m_reactorWakeFd = -1;
+    uint64_t m_reactorArmedNs = 0;
+    std::atomic<std::thread::id> m_reactorThread{};
+    std::mutex m_reactorMutex;
+    std::vector<std::function<void()>> m_reactorQueue;
+    std::vector<std::function<void()>> m_reactorRunning;  // reactor thread only
+    
+    bool onReactorThread() const {
+        return m_reactorFd >= 0 && m_reactorThread.load(std::memory_order_relaxed) == std::this_thread::get_id();
+    }
+    
+    void wakeReactor() {
+        uint64_t one = 1;
+        write(m_reactorWakeFd, &one, sizeof(one));
+    }
+    
+    bool openReactor() {
+        m_reactorFd = epoll_create1(EPOLL_CLOEXEC);
+        m_reactorTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        m_reactorWakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        bool ok = m_reactorFd >= 0 && m_reactorTimerFd >= 0 && m_reactorWakeFd >= 0;
+        
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.u64 = kReactorTimer;
+        ok = ok && epoll_ctl(m_reactorFd, EPOLL_CTL_ADD, m_reactorTimerFd, &ev) == 0;
+        ev.data.u64 = kReactorWake;
+        ok = ok && epoll_ctl(m_reactorFd, EPOLL_CTL_ADD, m_reactorWakeFd, &ev) == 0;
+        for (size_t i = 0; ok && i < m_inputDevices.size(); ++i) {
+            ev.data.u64 = kReactorDevices + i;
+            ok = epoll_ctl(m_reactorFd, EPOLL_CTL_ADD, m_inputDevices[i].fd, &ev) == 0;
+        }
+        if (!ok) {
+            std::cerr << "Failed to set up epoll loop: " << strerror(errno) << std::endl;
+            closeReactor();
+            return false;
+        }
+        
+        // Take over tasks queued before init from the scheduler thread
+        stopSchedulerThread();
+        m_reactorArmedNs = 0;
+#ifdef INPCTRL_IO_URING
+        if (m_options.ioUring) openUring();
+#else
+        if (m_options.ioUring) std::cerr << "Built without io_uring support, using epoll" << std::endl;
+#endif
+        return true;
+    }
+    
+    void closeReactor() {
+#ifdef INPCTRL_IO_URING
+        closeUring();
+#endif
+        for (int* fd : {&m_reactorFd, &m_reactorTimerFd, &m_reactorWakeFd}) {
+            if (*fd >= 0) close(*fd);
+            *fd = -1;
+        }
+        std::lock_guard<std::mutex> lock(m_reactorMutex);
+        m_reactorQueue.clear();
+    }
+    
+    void stopReactor() {
+        if (m_reactorFd < 0) return;
+        m_running = false;
+        wakeReactor();
+        if (m_listenerThread.joinable()) m_listenerThread.join();
+    }
+    
+    void reactorLoop() {
+        prepareThread();
+        m_reactorThread = std::this_thread::get_id();
+        while (m_running) {
+            reactorPass(-1);
+        }
+        reactorSubmit();
+        m_reactorThread = std::thread::id();
+    }
+    
+    // Wait up to timeoutMs (-1 = until something happens) and handle
+    // everything that became ready
+    void reactorPass(int timeoutMs) {
+#ifdef INPCTRL_IO_URING
+        if (m_uring.fd >= 0) {
+            uringPass(timeoutMs);
+            finishReactorPass();
+            return;
+        }
+#endif
+        struct epoll_event ready[32];
+        // Timers are in the epoll set, so spinning needs no deadline
+        int n = timeoutMs == 0 ? epoll_wait(m_reactorFd, ready, 32, 0) : spinThenWait(0, [&](bool block) {
+            m_ioSyscalls.fetch_add(1, std::memory_order_relaxed);
+            return epoll_wait(m_reactorFd, ready, 32, block ? timeoutMs : 0);
+        });
+        if (timeoutMs == 0) m_ioSyscalls.fetch_add(1, std::memory_order_relaxed);
+        
+        struct input_event events[64];
+        uint64_t counter;
+        for (int i = 0; i < n; ++i) {
+            uint64_t tag = ready[i].data.u64;
+            m_ioSyscalls.fetch_add(1, std::memory_order_relaxed);
+            if (tag == kReactorTimer) {
+                read(m_reactorTimerFd, &counter, sizeof(counter));
+                m_reactorArmedNs = 0;
+                continue;
+            }
+            if (tag == kReactorWake) {
+                read(m_reactorWakeFd, &counter, sizeof(counter));
+                continue;
+            }
+            
+            InputDevice& dev = m_inputDevices[tag - kReactorDevices];
+            if (ready[i].events & (EPOLLERR | EPOLLHUP)) {
+                // Device went away, stop polling it
+                epoll_ctl(m_reactorFd, EPOLL_CTL_DEL, dev.fd, nullptr);
+                continue;
+            }
+            ssize_t count = read(dev.fd, events, sizeof(events));
+            if (count > 0) {
+                m_ioEventsIn.fetch_add(count / sizeof(struct input_event), std::memory_order_relaxed);
+                processEvents(dev, events, count / sizeof(struct input_event));
+            }
+        }
+        finishReactorPass();
+    }
+    
+    // Everything a pass does after handling its ready sources
+    void finishReactorPass() {
+        runReactorCommands();
+        expireDebounce(monotonicNowNs());
+        {
+            std::unique_lock<std::mutex> lock(m_schedMutex);
+            runDueTasks(lock, m_schedBatch);
+            uint64_t deadline = m_schedQueue.empty() ? 0 :
+                static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    m_schedQueue.front().first.time_since_epoch()).count());
+            lock.unlock();
+            if (m_nextDebounceNs && (deadline == 0 || m_nextDebounceNs < deadline)) {
+                deadline = m_nextDebounceNs;
+            }
+            armReactorTimer(deadline);
+        }
+        flushListenerBatch();
+    }
+    
+    void runReactorCommands() {
+        {
+            std::lock_guard<std::mutex> lock(m_reactorMutex);
+            if (m_reactorQueue.empty()) return;
+            m_reactorRunning.swap(m_reactorQueue);
+        }
+        for (auto& command : m_reactorRunning) command();
+        m_reactorRunning.clear();
+    }
+    
+    // steady_clock counts CLOCK_MONOTONIC on Linux, so scheduler deadlines
+    // and debounce deadlines share the timerfd's clock. 0 disarms.
+    void armReactorTimer(uint64_t deadlineNs) {
+        if (deadlineNs == m_reactorArmedNs) return;
+        m_ioSyscalls.fetch_add(1, std::memory_order_relaxed);
+        struct itimerspec spec;
+        memset(&spec, 0, sizeof(spec));
+        spec.it_value.tv_sec = static_cast<time_t>(deadlineNs / 1000000000ULL);
+        spec.it_value.tv_nsec = static_cast<long>(deadlineNs % 1000000000ULL);
+        timerfd_settime(m_reactorTimerFd, TFD_TIMER_ABSTIME, &spec, nullptr);
+        m_reactorArmedNs = deadlineNs;
+    }
+
+    std::atomic<uint64_t> m_ioSyscalls{0};
+    std::atomic<uint64_t> m_ioEventsIn{0};
+    std::atomic<uint64_t> m_ioEventsOut{0};
+    
+    // Output flushed on the reactor thread is counted for getIoStats() and,
+    // with io_uring, queued on the ring. False means write() it now.
+    bool queueReactorWrite(const struct input_event* events, size_t count) {
+        if (!onReactorThread()) return false;
+        m_ioEventsOut.fetch_add(count, std::memory_order_relaxed);
+#ifdef INPCTRL_IO_URING
+        if (m_uring.fd >= 0) {
+            uringQueueWrite(events, count);
+            return true;
+        }
+#endif
+        m_ioSyscalls.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    
+    // Submit output queued on the ring without waiting, when no further
+    // pass follows to carry it
+    void reactorSubmit() {
+#ifdef INPCTRL_IO_URING
+        if (m_uring.fd >= 0) uringEnter(0);
+#endif
+    }
+
+#ifdef INPCTRL_IO_URING
+    // ==================== IO_URING ====================
+    // Optional reactor backend. Every source of the epoll set has a read
+    // posted on the ring into a registered buffer, re-armed as it completes.
+    // Output flushed during a pass becomes write SQEs linked in order, and
+    // the single io_uring_enter() waiting for the next completion submits
+    // them together with the re-armed reads. No SQPOLL: the kernel only
+    // looks at the rings inside io_uring_enter(), on the reactor thread.
+    static constexpr uint64_t kUringWrite = 1ULL << 63;  // | output buffer index
+    static constexpr size_t kUringSlotEvents = 64;       // read buffer per source
+    
+    struct Uring {
+        int fd = -1;
+        void* map = MAP_FAILED;  // SQ and CQ rings (IORING_FEAT_SINGLE_MMAP)
+        size_t mapSize = 0;
+        struct io_uring_sqe* sqes = static_cast<struct io_uring_sqe*>(MAP_FAILED);
+        size_t sqesSize = 0;
+        unsigned* sqHead = nullptr;
+        unsigned* sqTail = nullptr;
+        unsigned* sqArray = nullptr;
+        unsigned sqMask = 0;
+        unsigned sqEntries = 0;
+        unsigned* cqHead = nullptr;
+        unsigned* cqTail = nullptr;
+        unsigned cqMask = 0;
+        struct io_uring_cqe* cqes = nullptr;
+        unsigned queued = 0;                       // SQEs not yet submitted
+        unsigned queuedWrites = 0;                 // of which writes
+        struct io_uring_sqe* lastWrite = nullptr;  // this pass's last write
+        bool fixed = false;                        // read buffers registered
+    };
+    
+    Uring m_uring;
+    std::vector<struct input_event> m_uringReadBuf;
+    std::vector<std::vector<struct input_event>> m_uringOut;  // write buffers
+    std::vector<size_t> m_uringOutFree;
+    
+    bool openUring() {
+        struct io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        m_uring.fd = static_cast<int>(syscall(__NR_io_uring_setup, 256, &params));
+        const char* failed = nullptr;
+        if (m_uring.fd < 0) {
+            failed = "io_uring_setup";
+        } else if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_EXT_ARG)) {
+            errno = ENOSYS;
+            failed = "kernel features";
+        }
+        
+        if (!failed) {
+            m_uring.mapSize = std::max<size_t>(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+                                               params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe));
+            m_uring.map = mmap(nullptr, m_uring.mapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                               m_uring.fd, IORING_OFF_SQ_RING);
+            m_uring.sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+            m_uring.sqes = static_cast<struct io_uring_sqe*>(mmap(nullptr, m_uring.sqesSize, PROT_READ | PROT_WRITE,
+                                                                  MAP_SHARED | MAP_POPULATE, m_uring.fd, IORING_OFF_SQES));
+            if (m_uring.map == MAP_FAILED || m_uring.sqes == MAP_FAILED) failed = "mmap";
+        }
+        if (failed) {
+            std::cerr << "io_uring unavailable, using epoll: " << failed << ": " << strerror(errno) << std::endl;
+            closeUring();
+            return false;
+        }
+        
+        char* ring = static_cast<char*>(m_uring.map);
+        m_uring.sqHead = reinterpret_cast<unsigned*>(ring + params.sq_off.head);
+        m_uring.sqTail = reinterpret_cast<unsigned*>(ring + params.sq_off.tail);
+        m_uring.sqArray = reinterpret_cast<unsigned*>(ring + params.sq_off.array);
+        m_uring.sqMask = *reinterpret_cast<unsigned*>(ring + params.sq_off.ring_mask);
+        m_uring.sqEntries = params.sq_entries;
+        m_uring.cqHead = reinterpret_cast<unsigned*>(ring + params.cq_off.head);
+        m_uring.cqTail = reinterpret_cast<unsigned*>(ring + params.cq_off.tail);
+        m_uring.cqMask = *reinterpret_cast<unsigned*>(ring + params.cq_off.ring_mask);
+        m_uring.cqes = reinterpret_cast<struct io_uring_cqe*>(ring + params.cq_off.cqes);
+        
+        // One read buffer per source, registered so reads skip the page
+        // pinning of every request; plain reads if registration fails
+        size_t slots = kReactorDevices + m_inputDevices.size();
+        m_uringReadBuf.assign(slots * kUringSlotEvents, input_event());
+        std::vector<struct iovec> iovs(slots);
+        for (size_t slot = 0; slot < slots; ++slot) {
+            iovs[slot].iov_base = m_uringReadBuf.data() + slot * kUringSlotEvents;
+            iovs[slot].iov_len = kUringSlotEvents * sizeof(struct input_event);
+        }
+        m_uring.fixed = syscall(__NR_io_uring_register, m_uring.fd, IORING_REGISTER_BUFFERS,
+                                iovs.data(), static_cast<unsigned>(slots)) == 0;
+        for (size_t slot = 0; slot < slots; ++slot) uringQueueRead(slot);
+        // Post them now so the ring fd can signal readiness before any pass
+        uringEnter(0);
+        return true;
+    }
+    
+    void closeUring() {
+        if (m_uring.sqes != MAP_FAILED) munmap(m_uring.sqes, m_uring.sqesSize);
+        if (m_uring.map != MAP_FAILED) munmap(m_uring.map, m_uring.mapSize);
+        if (m_uring.fd >= 0) close(m_uring.fd);
+        m_uring = Uring();
+        m_uringReadBuf.clear();
+        m_uringOut.clear();
+        m_uringOutFree.clear();
+    }
+    
+    // Next free SQE, already counted as queued. The kernel only reads it at
+    // the next io_uring_enter(), so the caller may fill it in afterwards.
+    struct io_uring_sqe* uringSqe() {
+        unsigned tail = *m_uring.sqTail;
+        if (tail - __atomic_load_n(m_uring.sqHead, __ATOMIC_ACQUIRE) >= m_uring.sqEntries) {
+            uringEnter(0);  // ring full, hand over what is queued
+        }
+        unsigned index = tail & m_uring.sqMask;
+        struct io_uring_sqe* sqe = &m_uring.sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        m_uring.sqArray[index] = index;
+        __atomic_store_n(m_uring.sqTail, tail + 1, __ATOMIC_RELEASE);
+        m_uring.queued++;
+        return sqe;
+    }
+    
+    int reactorSlotFd(uint64_t slot) const {
+        if (slot == kReactorTimer) return m_reactorTimerFd;
+        if (slot == kReactorWake) return m_reactorWakeFd;
+        return m_inputDevices[slot - kReactorDevices].fd;
+    }
+    
+    void uringQueueRead(uint64_t slot) {
+        struct io_uring_sqe* sqe = uringSqe();
+        sqe->opcode = m_uring.fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+        sqe->fd = reactorSlotFd(slot);
+        sqe->addr = reinterpret_cast<uint64_t>(m_uringReadBuf.data() + slot * kUringSlotEvents);
+        sqe->len = slot < kReactorDevices ? sizeof(uint64_t) : kUringSlotEvents * sizeof(struct input_event);
+        sqe->off = static_cast<uint64_t>(-1);  // stream fds, no offset
+        sqe->buf_index = static_cast<uint16_t>(slot);
+        sqe->user_data = slot;
+    }
+    
+    void uringQueueWrite(const struct input_event* events, size_t count) {
+        size_t index;
+        if (m_uringOutFree.empty()) {
+            index = m_uringOut.size();
+            m_uringOut.emplace_back();
+        } else {
+            index = m_uringOutFree.back();
+            m_uringOutFree.pop_back();
+        }
+        std::vector<struct input_event>& buffer = m_uringOut[index];
+        buffer.assign(events, events + count);
+        
+        struct io_uring_sqe* sqe = uringSqe();
+        sqe->opcode = IORING_OP_WRITE;
+        sqe->fd = m_uinputFd;
+        sqe->addr = reinterpret_cast<uint64_t>(buffer.data());
+        sqe->len = static_cast<uint32_t>(count * sizeof(struct input_event));
+        sqe->off = static_cast<uint64_t>(-1);
+        sqe->user_data = kUringWrite | index;
+        m_uring.queuedWrites++;
+        // Writes of one pass reach uinput in the order they were flushed
+        if (m_uring.lastWrite) m_uring.lastWrite->flags |= IOSQE_IO_LINK;
+        m_uring.lastWrite = sqe;
+    }
+    
+    // Submit everything queued and wait up to timeoutMs (-1 forever, 0 not
+    // at all) for a completion. Returns the completions ready to reap.
+    int uringEnter(int timeoutMs) {
+        if (m_uring.queued > 0 || timeoutMs != 0) {
+            struct __kernel_timespec ts;
+            struct io_uring_getevents_arg arg;
+            memset(&arg, 0, sizeof(arg));
+            if (timeoutMs > 0) {
+                ts.tv_sec = timeoutMs / 1000;
+                ts.tv_nsec = (timeoutMs % 1000) * 1000000LL;
+                arg.ts = reinterpret_cast<uint64_t>(&ts);
+            }
+            // Writes complete inline, so waiting for them as well keeps their
+            // completions from ending the wait before any input arrives
+            unsigned wait = timeoutMs != 0 ? 1 + m_uring.queuedWrites : 0;
+            unsigned flags = IORING_ENTER_EXT_ARG | (wait ? IORING_ENTER_GETEVENTS : 0);
+            long submitted = syscall(__NR_io_uring_enter, m_uring.fd, m_uring.queued, wait, flags, &arg, sizeof(arg));
+            m_ioSyscalls.fetch_add(1, std::memory_order_relaxed);
+            if (submitted > 0) m_uring.queued -= std::min<unsigned>(m_uring.queued, static_cast<unsigned>(submitted));
+            m_uring.lastWrite = nullptr;
+            m_uring.queuedWrites = 0;
+        }
+        return static_cast<int>(__atomic_load_n(m_uring.cqTail, __ATOMIC_ACQUIRE) - *m_uring.cqHead);
+    }
+    
+    // Reap every completion: hand device reads to processEvents, recycle
+    // write buffers and re-arm the reads
+    void uringPass(int timeoutMs) {
+        if (timeoutMs == 0) {
+            uringEnter(0);
+        } else {
+            // Spinning checks the CQ ring without a syscall once nothing is queued
+            spinThenWait(0, [&](bool block) { return uringEnter(block ? timeoutMs : 0); });
+        }
+        
+        unsigned head = *m_uring.cqHead;
+        unsigned tail = __atomic_load_n(m_uring.cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            const struct io_uring_cqe& cqe = m_uring.cqes[head & m_uring.cqMask];
+            uint64_t tag = cqe.user_data;
+            int res = cqe.res;
+            
+            if (tag & kUringWrite) {
+                if (res < 0 && res != -ECANCELED) {
+                    std::cerr << "uinput write failed: " << strerror(-res) << std::endl;
+                }
+                m_uringOutFree.push_back(static_cast<size_t>(tag & ~kUringWrite));
+                continue;
+            }
+            if (tag < kReactorDevices) {
+                if (tag == kReactorTimer) m_reactorArmedNs = 0;
+                uringQueueRead(tag);
+                continue;
+            }
+            
+            if (res > 0) {
+                size_t count = static_cast<size_t>(res) / sizeof(struct input_event);
+                m_ioEventsIn.fetch_add(count, std::memory_order_relaxed);
+                processEvents(m_inputDevices[tag - kReactorDevices],
+                              m_uringReadBuf.data() + tag * kUringSlotEvents, count);
+            }
+            // A device that went away (ENODEV) is not read again
+            if (res > 0 || res == -EAGAIN || res == -EINTR) uringQueueRead(tag);
+        }
+        __atomic_store_n(m_uring.cqHead, head, __ATOMIC_RELEASE);
+    }
+#endif
+
+    // ==================== BUSY POLL ====================
+    // Within spinUs of the last physical input the wait is a zero-timeout
+    // poll in a loop, so the next event is picked up without a wakeup.
+    // Once input goes quiet the loop blocks as usual.
+    uint64_t m_lastInputNs = 0;  // listener thread only
+    std::atomic<uint64_t> m_spinNs{0};
+    std::atomic<uint64_t> m_blockNs{0};
+    std::atomic<uint64_t> m_spinWakeups{0};
+    std::atomic<uint64_t> m_blockWakeups{0};
+    
+    // `wait(block)` polls once, blocking or not, and returns the ready
+    // count. Spinning also stops at deadlineNs (0 for none).
+    template<typename Wait>
+    int spinThenWait(uint64_t deadlineNs, Wait wait) {
+        uint64_t now = monotonicNowNs();
+        uint64_t spinEnd = m_lastInputNs + m_options.spinUs * 1000ULL;
+        if (m_options.spinUs > 0 && now < spinEnd) {
+            uint64_t start = now;
+            int ready = 0;
+            while (ready == 0 && now < spinEnd && (deadlineNs == 0 || now < deadlineNs) && m_running) {
+                ready = wait(false);
+                now = monotonicNowNs();
+            }
+            m_spinNs.fetch_add(now - start, std::memory_order_relaxed);
+            if (ready > 0) m_spinWakeups.fetch_add(1, std::memory_order_relaxed);
+            if (ready != 0 || now < spinEnd) return ready;
+        }
+        
+        uint64_t start = now;
+        int ready = wait(true);
+        m_blockNs.fetch_add(monotonicNowNs() - start, std::memory_order_relaxed);
+        if (ready > 0) m_blockWakeups.fetch_add(1, std::memory_order_relaxed);
+        return ready;
+    }
+
+    // Handle one batch of events read from a device
+    void processEvents(InputDevice& dev, struct input_event* events, size_t count,
+                       bool applyDebounce = true) {
+        // Log what the device sent, before any filtering; synthesized
+        // debounce edges (applyDebounce false) are not device input
+        if (applyDebounce && !dev.isVirtual) {
+            flightLog(events, count, FlightSource::Captured);
+            uint64_t now = monotonicNowNs();
+            uint64_t sent = eventTimeNs(events[0]);
+            if (now > sent) m_pickupLatency.record(now - sent);
+            m_lastInputNs = now;
+        }
+        
+        if (applyDebounce && !dev.isVirtual) {
+            std::shared_ptr<const DebounceConfig> config = debounceConfig();
+            if (config) count = debounceEvents(dev, *config, events, count);
+        }
+        if (count == 0) return;
+        
+        std::shared_ptr<const RuleTable> rules;
+        std::shared_ptr<const MotionSubscribers> motionSubscribers;
+        if (!dev.isVirtual) {
+            std::lock_guard<std::mutex> lock(m_ruleMutex);
+            rules = m_ruleTable;
+            motionSubscribers = m_motionSubscribers;
+        }
+        
+        // Recorded as the device sent it, before remapping rewrites or drops
+        // anything. No lock: see m_liveRecorder.
+        if (!dev.isVirtual) {
+            m_recorderInUse.store(true);
+            Recorder* recorder = m_liveRecorder.load();
+            if (recorder) recordEvents(*recorder, events, count);
+            m_recorderInUse.store(false);
+        }
+        
+        // Grabbed devices are rewritten in place and re-emitted with this
+        // pass's output; everything below then sees the remapped events
+        bool grabbed;
+        std::shared_ptr<const RemapPipeline> pipeline;
+        {
+            std::lock_guard<std::mutex> lock(m_remapMutex);
+            grabbed = dev.grabbed;
+            if (grabbed) pipeline = m_remapPipeline;
+        }
+        if (grabbed) {
+            uint64_t arrivalNs = eventTimeNs(events[count - 1]);
+            if (pipeline) count = runRemapPipeline(*pipeline, events, count);
+            if (m_options.kernelRepeat) {
+                // The kernel already repeats keys held on the virtual
+                // device; passing the device's own repeats would double them
+                for (size_t i = 0; i < count; ++i) {
+                    if (events[i].type == EV_KEY && events[i].value == 2) continue;
+                    m_listenerBatch.append(&events[i], 1);
+                }
+            } else {
+                m_listenerBatch.append(events, count);
+            }
+            m_pendingRemapNs.push_back(arrivalNs);
+        }
+        
+        for (size_t i = 0; i < count; ++i) {
+            const struct input_event& ev = events[i];
+            if (ev.type == EV_REL || ev.type == EV_SYN) {
+                if (!dev.isVirtual) trackMotion(dev, ev, motionSubscribers.get());
+                continue;
+            }
+            if (ev.type != EV_KEY) continue;
+            
+            unsigned int winCode = keyCodeFromEvdev(ev.code);
+            if (winCode == 0) continue;
+            {
+                std::lock_guard<std::mutex> lock(m_keyMutex);
+                m_keyStates[winCode] = (ev.value != 0);
+            }
+            if (ev.value != 2) notifyKeyWaiters(winCode, ev.value != 0);
+            
+            if (dev.isVirtual) continue;
+            if (ev.value != 2) turboTriggerEdge(winCode, ev.value != 0);
+            if (ev.code < 256) feedHotstrings(ev);
+            if (rules) dispatchRules(*rules, winCode, ev);
+        }
+    }
+
+    // Add relative motion to the totals and hand each finished report to
+    // the motion subscribers
+    void trackMotion(InputDevice& dev, const struct input_event& ev,
+                     const MotionSubscribers* subscribers) {
+        if (ev.type == EV_SYN) {
+            if (ev.code != SYN_REPORT || !dev.hasMotion) return;
+            if (subscribers) {
+                for (const auto& sub : *subscribers) sub.second(dev.motion);
+            }
+            dev.motion = MouseDelta();
+            dev.hasMotion = false;
+            return;
+        }
+        
+        int slot;
+        switch (ev.code) {
+            case REL_X:      slot = 0; dev.motion.dx += ev.value; break;
+            case REL_Y:      slot = 1; dev.motion.dy += ev.value; break;
+            case REL_WHEEL:  slot = 2; dev.motion.wheel += ev.value; break;
+            case REL_HWHEEL: slot = 3; dev.motion.hwheel += ev.value; break;
+            default: return;
+        }
+        m_mouseMotion[slot].fetch_add(ev.value, std::memory_order_relaxed);
+        dev.hasMotion = true;
+    }
+
+    size_t runRemapPipeline(const RemapPipeline& pipeline, struct input_event* events, size_t count) {
+        for (const auto& entry : pipeline) {
+            uint64_t start = monotonicNowNs();
+            count = entry->stage(events, count);
+            entry->timing.record(monotonicNowNs() - start);
+        }
+        return count;
+    }
+
+    std::shared_ptr<const DebounceConfig> debounceConfig() {
+        std::lock_guard<std::mutex> lock(m_debounceMutex);
+        return m_debounceConfig;
+    }
+
+    void scheduleDebounce(KeyDebouncer& db, uint16_t code, uint64_t deadline) {
+        if (db.deadlineNs[code] == 0) db.pending.push_back(code);
+        db.deadlineNs[code] = deadline;
+        if (m_nextDebounceNs == 0 || deadline < m_nextDebounceNs) m_nextDebounceNs = deadline;
+    }
+
+    // Filter key chatter out of a batch in place; returns the new count
+    size_t debounceEvents(InputDevice& dev, const DebounceConfig& config,
+                          struct input_event* events, size_t count) {
+        if (!dev.debounce) {
+            dev.debounce = std::make_shared<KeyDebouncer>();
+            // Seed with the keys already held so the first release passes
+            uint8_t bits[KEY_CNT / 8] = {0};
+            ioctl(dev.fd, EVIOCGKEY(sizeof(bits)), bits);
+            for (unsigned int code = 0; code < KEY_CNT; ++code) {
+                uint8_t down = (bits[code / 8] >> (code % 8)) & 1;
+                dev.debounce->raw[code] = dev.debounce->reported[code] = down;
+            }
+        }
+        KeyDebouncer& db = *dev.debounce;
+        
+        size_t kept = 0;
+        for (size_t i = 0; i < count; ++i) {
+            const struct input_event& ev = events[i];
+            uint16_t code = ev.code;
+            uint64_t threshold = (ev.type == EV_KEY && code < KEY_CNT)
+                ? config.thresholdUs[code] * 1000ULL : 0;
+            if (threshold == 0) {
+                if (ev.type == EV_KEY && code < KEY_CNT && ev.value != 2) {
+                    db.raw[code] = db.reported[code] = (ev.value != 0);
+                }
+                events[kept++] = ev;
+                continue;
+            }
+            
+            // Autorepeat only follows a settled press
+            if (ev.value == 2) {
+                if (db.reported[code] && db.deadlineNs[code] == 0) events[kept++] = ev;
+                continue;
+            }
+            
+            uint8_t value = (ev.value != 0);
+            uint64_t t = eventTimeNs(ev);
+            db.raw[code] = value;
+            
+            if (config.mode == DebounceMode::Eager) {
+                if (value == db.reported[code]) {
+                    db.deadlineNs[code] = 0;  // bounced back, nothing to resolve
+                } else if (t - db.lastEdgeNs[code] >= threshold) {
+                    db.reported[code] = value;
+                    db.lastEdgeNs[code] = t;
+                    events[kept++] = ev;
+                } else {
+                    // Too close to the last edge. If the key is still in
+                    // this state when the window closes the edge is replayed.
+                    m_bounceCounts[code].fetch_add(1, std::memory_order_relaxed);
+                    scheduleDebounce(db, code, db.lastEdgeNs[code] + threshold);
+                }
+            } else {
+                if (value == db.reported[code]) {
+                    if (db.deadlineNs[code]) {
+                        db.deadlineNs[code] = 0;
+                        m_bounceCounts[code].fetch_add(1, std::memory_order_relaxed);
+                    }
+                } else {
+                    scheduleDebounce(db, code, t + threshold);
+                }
+            }
+        }
+        return kept;
+    }
+
+    // Let through every debounced edge whose window has closed by `now`
+    void expireDebounce(uint64_t now) {
+        if (m_nextDebounceNs == 0 || now < m_nextDebounceNs) return;
+        m_nextDebounceNs = 0;
+        
+        for (InputDevice& dev : m_inputDevices) {
+            if (!dev.debounce || dev.debounce->pending.empty()) continue;
+            KeyDebouncer& db = *dev.debounce;
+            
+            size_t keep = 0;
+            for (size_t i = 0; i < db.pending.size(); ++i) {
+                uint16_t code = db.pending[i];
+                uint64_t deadline = db.deadlineNs[code];
+                if (deadline == 0) continue;
+                if (deadline > now) {
+                    db.pending[keep++] = code;
+                    if (m_nextDebounceNs == 0 || deadline < m_nextDebounceNs) m_nextDebounceNs = deadline;
+                    continue;
+                }
+                db.deadlineNs[code] = 0;
+                if (db.raw[code] == db.reported[code]) continue;
+                
+                db.reported[code] = db.raw[code];
+                db.lastEdgeNs[code] = deadline;
+                struct input_event synth[2];
+                memset(synth, 0, sizeof(synth));
+                synth[0].input_event_sec = deadline / 1000000000ULL;
+                synth[0].input_event_usec = (deadline % 1000000000ULL) / 1000;
+                synth[0].type = EV_KEY;
+                synth[0].code = code;
+                synth[0].value = db.raw[code];
+                synth[1] = synth[0];
+                synth[1].type = EV_SYN;
+                synth[1].code = SYN_REPORT;
+                synth[1].value = 0;
+                processEvents(dev, synth, 2, false);
+            }
+            db.pending.resize(keep);
+        }
+    }
+
+    // Send everything queued during this pass (rule outputs and remapped
+    // events) in one write and record the latency of each
+    void flushListenerBatch() {
+        if (m_listenerBatch.empty()) {
+            m_pendingRemapNs.clear();
+            return;
+        }
+        // Passed-through device events keep their own repeats
+        if (m_uinputFd >= 0) writeEvents(m_listenerBatch.events.data(), m_listenerBatch.events.size());
+        m_listenerBatch.clear();
+        uint64_t now = monotonicNowNs();
+        for (uint64_t triggerNs : m_pendingTriggerNs) {
+            m_ruleLatency.record(now > triggerNs ? now - triggerNs : 0);
+        }
+        for (uint64_t arrivalNs : m_pendingRemapNs) {
+            m_remapLatency.record(now > arrivalNs ? now - arrivalNs : 0);
+        }
+        m_pendingTriggerNs.clear();
+        m_pendingRemapNs.clear();
+    }
+    
+    void emitEvent(int type, int code, int val) {
+        if (m_uinputFd < 0) return;
+        
+        // Event and its sync go out in one write
+        struct input_event ie[2];
+        memset(ie, 0, sizeof(ie));
+        ie[0].type = type;
+        ie[0].code = code;
+        ie[0].value = val;
+        ie[1].type = EV_SYN;
+        ie[1].code = SYN_REPORT;
+        ie[1].value = 0;
+        emitEvents(ie, 2);
+    }
+
+    // Every uinput write goes through here. On the reactor thread the
+    // reports join the loop's single write at the end of the pass, so they
+    // keep their order with everything else emitted during it.
+    // Returns false if the write failed; deferred reports count as sent
+    bool emitEvents(const struct input_event* events, size_t count) {
+        if (m_uinputFd < 0) return false;
+        if (count == 0) return true;
+        bool written = true;
+        if (onReactorThread()) {
+            m_listenerBatch.append(events, count);
+        } else {
+            // Hotstrings and callbacks on the threaded listener write at
+            // once; the passthrough queued before them goes first
+            if (m_eventLoopThread.load(std::memory_order_relaxed) == std::this_thread::get_id()) {
+                flushListenerBatch();
+            }
+            written = writeEvents(events, count);
+        }
+        noteInjectedKeys(events, count);
+        return written;
+    }
+
+    bool writeEvents(const struct input_event* events, size_t count) {
+        flightLog(events, count, FlightSource::Injected);
+        if (queueReactorWrite(events, count)) return true;
+        ssize_t size = static_cast<ssize_t>(count * sizeof(struct input_event));
+        return write(m_uinputFd, events, size) == size;
+    }
+
+    // Write every queued report with a single syscall and empty the batch
+    void emitBatch(EventBatch& batch) {
+        emitEvents(batch.events.data(), batch.events.size());
+        batch.clear();
+    }
+
+    // Close the open report, if anything was queued since the last one
+    void endReport(EventBatch& batch) {
+        if (batch.reportOpen()) batch.sync();
+    }
+
+    void queueButton(EventBatch& batch, Key button, bool down) {
+        batch.add(EV_KEY, toEvdevCode(static_cast<unsigned int>(button)), down ? 1 : 0);
+    }
+
+    void queueMove(EventBatch& batch, int dx, int dy) {
+        if (dx) batch.rel(REL_X, dx);
+        if (dy) batch.rel(REL_Y, dy);
+    }
+
+    // Hi-res units go out as they are; the classic wheel axes get a notch
+    // each time the accumulated hi-res motion crosses 120
+    void queueScroll(EventBatch& batch, int hiResV, int hiResH) {
+        if (hiResV) {
+            batch.rel(REL_WHEEL_HI_RES, hiResV);
+            int notches = accumulateNotches(m_wheelRemainder[0], hiResV);
+            if (notches) batch.rel(REL_WHEEL, notches);
+        }
+        if (hiResH) {
+            batch.rel(REL_HWHEEL_HI_RES, hiResH);
+            int notches = accumulateNotches(m_wheelRemainder[1], hiResH);
+            if (notches) batch.rel(REL_HWHEEL, notches);
+        }
+    }
+
+    static int accumulateNotches(std::atomic<int>& remainder, int hiRes) {
+        int prev = remainder.load(std::memory_order_relaxed);
+        int notches, next;
+        do {
+            int total = prev + hiRes;
+            notches = total / 120;
+            next = total - notches * 120;
+        } while (!remainder.compare_exchange_weak(prev, next, std::memory_order_relaxed));
+        return notches;
+    }
+    
+    void holdKeyLinux(unsigned int evdevCode) {
+        emitEvent(EV_KEY, evdevCode, 1);
+    }
+    
+    void releaseKeyLinux(unsigned int evdevCode) {
+        emitEvent(EV_KEY, evdevCode, 0);
+    }
+    
+    void moveMouseLinux(int dx, int dy) {
+        // Both axes in one report so the pointer moves diagonally in one step
+        EventBatch batch;
+        queueMove(batch, dx, dy);
+        batch.sync();
+        emitBatch(batch);
+    }
+
+    // Map of common ASCII characters to their Linux key codes and shift requirements
+    static const std::unordered_map<char, KeyMapping>& linuxCharMap() {
+        static const std::unordered_map<char, KeyMapping> charMap = {
+            // Lowercase letters
+            {'a', {KEY_A, false}}, {'b', {KEY_B, false}}, {'c', {KEY_C, false}},
+            {'d', {KEY_D, false}}, {'e', {KEY_E, false}}, {'f', {KEY_F, false}},
+            {'g', {KEY_G, false}}, {'h', {KEY_H, false}}, {'i', {KEY_I, false}},
+            {'j', {KEY_J, false}}, {'k', {KEY_K, false}}, {'l', {KEY_L, false}},
+            {'m', {KEY_M, false}}, {'n', {KEY_N, false}}, {'o', {KEY_O, false}},
+            {'p', {KEY_P, false}}, {'q', {KEY_Q, false}}, {'r', {KEY_R, false}},
             {'s', {KEY_S, false}}, {'t', {KEY_T, false}}, {'u', {KEY_U, false}},
             {'v', {KEY_V, false}}, {'w', {KEY_W, false}}, {'x', {KEY_X, false}},
             {'y', {KEY_Y, false}}, {'z', {KEY_Z, false}},
+        
+            // Uppercase letters
+            {'A', {KEY_A, true}}, {'B', {KEY_B, true}}, {'C', {KEY_C, true}},
+            {'D', {KEY_D, true}}, {'E', {KEY_E, true}}, {'F', {KEY_F, true}},
+            {'G', {KEY_G, true}}, {'H', {KEY_H, true}}, {'I', {KEY_I, true}},
+            {'J', {KEY_J, true}}, {'K', {KEY_K, true}}, {'L', {KEY_L, true}},
+            {'M', {KEY_M, true}}, {'N', {KEY_N, true}}, {'O', {KEY_O, true}},
+            {'P', {KEY_P, true}}, {'Q', {KEY_Q, true}}, {'R', {KEY_R, true}},
+            {'S', {KEY_S, true}}, {'T', {KEY_T, true}}, {'U', {KEY_U, true}},
+            {'V', {KEY_V, true}}, {'W', {KEY_W, true}}, {'X', {KEY_X, true}},
+            {'Y', {KEY_Y, true}}, {'Z', {KEY_Z, true}},
+        
+            // Numbers
+            {'0', {KEY_0, false}}, {'1', {KEY_1, false}}, {'2', {KEY_2, false}},
+            {'3', {KEY_3, false}}, {'4', {KEY_4, false}}, {'5', {KEY_5, false}},
+            {'6', {KEY_6, false}}, {'7', {KEY_7, false}}, {'8', {KEY_8, false}},
+            {'9', {KEY_9, false}},
+        
+            // Shifted numbers (symbols)
+            {'!', {KEY_1, true}}, {'@', {KEY_2, true}}, {'#', {KEY_3, true}},
+            {'$', {KEY_4, true}}, {'%', {KEY_5, true}}, {'^', {KEY_6, true}},
+            {'&', {KEY_7, true}}, {'*', {KEY_8, true}}, {'(', {KEY_9, true}},
+            {')', {KEY_0, true}},
+        
+            // Special characters
+            {' ', {KEY_SPACE, false}}, {'\n', {KEY_ENTER, false}}, {'\t', {KEY_TAB, false}},
+            {'-', {KEY_MINUS, false}}, {'_', {KEY_MINUS, true}},
+            {'=', {KEY_EQUAL, false}}, {'+', {KEY_EQUAL, true}},
+            {'[', {KEY_LEFTBRACE, false}}, {'{', {KEY_LEFTBRACE, true}},
+            {']', {KEY_RIGHTBRACE, false}}, {'}', {KEY_RIGHTBRACE, true}},
+            {'\\', {KEY_BACKSLASH, false}}, {'|', {KEY_BACKSLASH, true}},
+            {';', {KEY_SEMICOLON, false}}, {':', {KEY_SEMICOLON, true}},
+            {'\'', {KEY_APOSTROPHE, false}}, {'"', {KEY_APOSTROPHE, true}},
+            {',', {KEY_COMMA, false}}, {'<', {KEY_COMMA, true}},
+            {'.', {KEY_DOT, false}}, {'>', {KEY_DOT, true}},
+            {'/', {KEY_SLASH, false}}, {'?', {KEY_SLASH, true}},
+            {'`', {KEY_GRAVE, false}}, {'~', {KEY_GRAVE, true}},
+            {'/', {KEY_SLASH, false}}, {':', {KEY_SEMICOLON, true}},
+            {'!', {KEY_1, true}}, {'@', {KEY_2, true}}, {'#', {KEY_3, true}},
+            {'$', {KEY_4, true}}, {'%', {KEY_5, true}}, {'^', {KEY_6, true}},
+            {'&', {KEY_7, true}}, {'*', {KEY_8, true}}, {'(', {KEY_9, true}},
+            {')', {KEY_0, true}}, {'-', {KEY_MINUS, false}}, {'_', {KEY_MINUS, true}},
+            {'=', {KEY_EQUAL, false}}, {'+', {KEY_EQUAL, true}}, {'\\', {KEY_BACKSLASH, false}},
+            {'|', {KEY_BACKSLASH, true}}, {';', {KEY_SEMICOLON, false}}, {':', {KEY_SEMICOLON, true}},
+            {'\'', {KEY_APOSTROPHE, false}}, {'"', {KEY_APOSTROPHE, true}}, {',', {KEY_COMMA, false}},
+            {'<', {KEY_COMMA, true}}, {'.', {KEY_DOT, false}}, {'>', {KEY_DOT, true}},
+            {'`', {KEY_GRAVE, false}}, {'~', {KEY_GRAVE, true}}
+
+        };
+        return charMap;
+    }
+
+    // Reverse of linuxCharMap(): evdev key code + shift state -> character,
+    // or 0 if the key does not type anything
+    static char decodeCharLinux(unsigned int keyCode, bool shift) {
+        static const std::vector<char> table = [] {
+            std::vector<char> t(256 * 2, 0);
+            for (const auto& entry : linuxCharMap()) {
+                t[entry.second.keyCode * 2 + (entry.second.needShift ? 1 : 0)] = entry.first;
+            }
+            t[KEY_SPACE * 2 + 1] = ' ';
+            return t;
+        }();
+        if (keyCode >= 256) return 0;
+        return table[keyCode * 2 + (shift ? 1 : 0)];
+    }
+
+    // Queue the key reports that type `text`, without any delay between keys
+    void appendTextLinux(EventBatch& batch, const std::string& text) {
+        const auto& charMap = linuxCharMap();
+        for (char c : text) {
+            auto it = charMap.find(c);
+            if (it == charMap.end()) {
+                std::cerr << "Character '" << c << "' not mapped for Linux" << std::endl;
+                continue;
+            }
+            if (it->second.needShift) batch.key(KEY_LEFTSHIFT, 1);
+            batch.key(it->second.keyCode, 1);
+            batch.key(it->second.keyCode, 0);
+            if (it->second.needShift) batch.key(KEY_LEFTSHIFT, 0);
+        }
+    }
+
+    void typeCharLinux(char c, int delayMs) {
+        const auto& charMap = linuxCharMap();
+        auto it = charMap.find(c);
+        if (it == charMap.end()) {
+            std::cerr << "Character '" << c << "' not mapped for Linux" << std::endl;
+            return;
+        }
+        
+        KeyMapping mapping = it->second;
+        
+        // Press shift if needed
+        if (mapping.needShift) {
+            holdKeyLinux(KEY_LEFTSHIFT);
+        }
+        
+        // Press the key
+        holdKeyLinux(mapping.keyCode);
+        std::this_thread::sleep_for(std::chrono::milliseconds(delayMs));
+        releaseKeyLinux(mapping.keyCode);
+        
+        // Release shift
+        if (mapping.needShift) {
+            releaseKeyLinux(KEY_LEFTSHIFT);
+        }
+    }
+    
+    static constexpr size_t sequenceEvents(Key) { return 4; }
+    template<size_t N>
+    static constexpr size_t sequenceEvents(KeyChord<N>) { return 2 * N + 2; }
+    static constexpr size_t sequenceEvents(SequencePause) { return 0; }
+
+    template<size_t N, size_t P>
+    static constexpr void appendSequenceEvent(EventSequence<N, P>& seq, size_t& at,
+                                              unsigned int type, unsigned int code, int value) {
+        seq.events[at].type = static_cast<uint16_t>(type);
+        seq.events[at].code = static_cast<uint16_t>(code);
+        seq.events[at].value = value;
+        at++;
+    }
+
+    template<size_t N, size_t P>
+    static constexpr void appendSequenceStep(EventSequence<N, P>& seq, size_t& at, size_t&, Key key) {
+        unsigned int code = toEvdevCode(static_cast<unsigned int>(key));
+        appendSequenceEvent(seq, at, EV_KEY, code, 1);
+        appendSequenceEvent(seq, at, EV_SYN, SYN_REPORT, 0);
+        appendSequenceEvent(seq, at, EV_KEY, code, 0);
+        appendSequenceEvent(seq, at, EV_SYN, SYN_REPORT, 0);
+    }
+
+    template<size_t N, size_t P, size_t K>
+    static constexpr void appendSequenceStep(EventSequence<N, P>& seq, size_t& at, size_t&,
+                                             const KeyChord<K>& chord) {
+        for (size_t i = 0; i < K; ++i) {
+            appendSequenceEvent(seq, at, EV_KEY, toEvdevCode(static_cast<unsigned int>(chord.keys[i])), 1);
+        }
+        appendSequenceEvent(seq, at, EV_SYN, SYN_REPORT, 0);
+        for (size_t i = K; i-- > 0;) {
+            appendSequenceEvent(seq, at, EV_KEY, toEvdevCode(static_cast<unsigned int>(chord.keys[i])), 0);
+        }
+        appendSequenceEvent(seq, at, EV_SYN, SYN_REPORT, 0);
+    }
+
+    template<size_t N, size_t P>
+    static constexpr void appendSequenceStep(EventSequence<N, P>& seq, size_t& at, size_t& segment,
+                                             SequencePause pause) {
+        seq.delaysMs[segment] = pause.ms;
+        seq.splits[++segment] = at;
+    }
+
+    // Windows virtual key code to evdev code. constexpr so fixed key
+    // sequences can be translated at compile time (see keySequence()).
+    static constexpr unsigned int toEvdevCode(unsigned int vkCode) {
+        switch (vkCode) {
+            case 0x41: return KEY_A;
+            case 0x42: return KEY_B;
+            case 0x43: return KEY_C;
+            case 0x44: return KEY_D;
+            case 0x45: return KEY_E;
+            case 0x46: return KEY_F;
+            case 0x47: return KEY_G;
+            case 0x48: return KEY_H;
+            case 0x49: return KEY_I;
+            case 0x4A: return KEY_J;
+            case 0x4B: return KEY_K;
+            case 0x4C: return KEY_L;
+            case 0x4D: return KEY_M;
+            case 0x4E: return KEY_N;
+            case 0x4F: return KEY_O;
+            case 0x50: return KEY_P;
+            case 0x51: return KEY_Q;
+            case 0x52: return KEY_R;
+            case 0x53: return KEY_S;
+            case 0x54: return KEY_T;
+            case 0x55: return KEY_U;
+            case 0x56: return KEY_V;
+            case 0x57: return KEY_W;
+            case 0x58: return KEY_X;
+            case 0x59: return KEY_Y;
+            case 0x5A: return KEY_Z;
+            case 0x30: return KEY_0;
+            case 0x31: return KEY_1;
+            case 0x32: return KEY_2;
+            case 0x33: return KEY_3;
+            case 0x34: return KEY_4;
+            case 0x35: return KEY_5;
+            case 0x36: return KEY_6;
+            case 0x37: return KEY_7;
+            case 0x38: return KEY_8;
+            case 0x39: return KEY_9;
+            case 0x70: return KEY_F1;
+            case 0x71: return KEY_F2;
+            case 0x72: return KEY_F3;
+            case 0x73: return KEY_F4;
+            case 0x74: return KEY_F5;
+            case 0x75: return KEY_F6;
+            case 0x76: return KEY_F7;
+            case 0x77: return KEY_F8;
+            case 0x78: return KEY_F9;
+            case 0x79: return KEY_F10;
+            case 0x7A: return KEY_F11;
+            case 0x7B: return KEY_F12;
+            case 0x20: return KEY_SPACE;
+            case 0x0D: return KEY_ENTER;
+            case 0x09: return KEY_TAB;
+            case 0x1B: return KEY_ESC;
+            case 0xA0: return KEY_LEFTSHIFT;
+            case 0xA1: return KEY_RIGHTSHIFT;
+            case 0xA2: return KEY_LEFTCTRL;
+            case 0xA3: return KEY_RIGHTCTRL;
+            case 0xA4: return KEY_LEFTALT;
+            case 0xA5: return KEY_RIGHTALT;
+            case 0xDB: return KEY_LEFTBRACE;
+            case 0xDD: return KEY_RIGHTBRACE;
+            case 0xBF: return KEY_SLASH;
+            case 0xBA: return KEY_SEMICOLON;
+            case 0xBD: return KEY_MINUS;
+            case 0xBB: return KEY_EQUAL;
+            case 0xDC: return KEY_BACKSLASH;
+            case 0xDE: return KEY_APOSTROPHE;
+            case 0xBC: return KEY_COMMA;
+            case 0xBE: return KEY_DOT;
+            case 0xC0: return KEY_GRAVE;
+            case 0x24: return KEY_HOME;
+            case 0x23: return KEY_END;
+            case 0x21: return KEY_PAGEUP;
+            case 0x22: return KEY_PAGEDOWN;
+            case 0x60: return KEY_KP0;
+            case 0x61: return KEY_KP1;
+            case 0x62: return KEY_KP2;
+            case 0x63: return KEY_KP3;
+            case 0x64: return KEY_KP4;
+            case 0x65: return KEY_KP5;
+            case 0x66: return KEY_KP6;
+            case 0x67: return KEY_KP7;
+            case 0x68: return KEY_KP8;
+            case 0x69: return KEY_KP9;
+            case 0x6A: return KEY_KPASTERISK;
+            case 0x6B: return KEY_KPPLUS;
+            case 0x6D: return KEY_KPMINUS;
+            case 0x6E: return KEY_KPDOT;
+            case 0x6F: return KEY_KPSLASH;
+            case 0x14: return KEY_CAPSLOCK;
+            case 0x90: return KEY_NUMLOCK;
+            case 0x91: return KEY_SCROLLLOCK;
+            case 0x2C: return KEY_SYSRQ;
+            case 0x13: return KEY_PAUSE;
+            case 0x5B: return KEY_LEFTMETA;
+            case 0x5C: return KEY_RIGHTMETA;
+            case 0x25: return KEY_LEFT;
+            case 0x26: return KEY_UP;
+            case 0x27: return KEY_RIGHT;
+            case 0x28: return KEY_DOWN;
+            case 0x08: return KEY_BACKSPACE;
+            case 0x2E: return KEY_DELETE;
+            case 0x2D: return KEY_INSERT;
+            case 0x01: return BTN_LEFT;
+            case 0x02: return BTN_RIGHT;
+            case 0x04: return BTN_MIDDLE;
+            case 0x05: return BTN_SIDE;
+            case 0x06: return BTN_EXTRA;
+            default: return vkCode;
+        }
+    }
+    
+    // Key code tracked by the listener for an evdev key or button code, or 0
+    static unsigned int keyCodeFromEvdev(unsigned int evdevCode) {
+        // Handle keyboard events
+        if (evdevCode < 256) return evdevCode ? fromEvdevCode(evdevCode) : 0;
+        // Handle mouse button events
+        if (evdevCode == BTN_LEFT) return 0x01;    // LMB
+        if (evdevCode == BTN_RIGHT) return 0x02;   // RMB
+        if (evdevCode == BTN_MIDDLE) return 0x04;  // MMB
+        if (evdevCode == BTN_SIDE) return 0x05;    // Mouse4
+        if (evdevCode == BTN_EXTRA) return 0x06;   // Mouse5
+        return 0;
+    }
+
+    // Convert evdev codes back to Windows VK codes
+    static unsigned int fromEvdevCode(unsigned int evdevCode) {
+        static std::unordered_map<unsigned int, unsigned int> evdevToVk = {
+            {KEY_A, 0x41}, {KEY_B, 0x42}, {KEY_C, 0x43}, {KEY_D, 0x44},
+            {KEY_E, 0x45}, {KEY_F, 0x46}, {KEY_G, 0x47}, {KEY_H, 0x48},
+            {KEY_I, 0x49}, {KEY_J, 0x4A}, {KEY_K, 0x4B}, {KEY_L, 0x4C},
+            {KEY_M, 0x4D}, {KEY_N, 0x4E}, {KEY_O, 0x4F}, {KEY_P, 0x50},
+            {KEY_Q, 0x51}, {KEY_R, 0x52}, {KEY_S, 0x53}, {KEY_T, 0x54},
+            {KEY_U, 0x55}, {KEY_V, 0x56}, {KEY_W, 0x57}, {KEY_X, 0x58},
+            {KEY_Y, 0x59}, {KEY_Z, 0x5A},
+            {KEY_0, 0x30}, {KEY_1, 0x31}, {KEY_2, 0x32}, {KEY_3, 0x33},
+            {KEY_4, 0x34}, {KEY_5, 0x35}, {KEY_6, 0x36}, {KEY_7, 0x37},
+            {KEY_8, 0x38}, {KEY_9, 0x39},
+            {KEY_F1, 0x70}, {KEY_F2, 0x71}, {KEY_F3, 0x72}, {KEY_F4, 0x73},
+            {KEY_F5, 0x74}, {KEY_F6, 0x75}, {KEY_F7, 0x76}, {KEY_F8, 0x77},
+            {KEY_F9, 0x78}, {KEY_F10, 0x79}, {KEY_F11, 0x7A}, {KEY_F12, 0x7B},
+            {KEY_SPACE, 0x20}, {KEY_ENTER, 0x0D}, {KEY_TAB, 0x09},
+            {KEY_ESC, 0x1B}, {KEY_LEFTSHIFT, 0xA0}, {KEY_RIGHTSHIFT, 0xA1},
+            {KEY_LEFTCTRL, 0xA2}, {KEY_RIGHTCTRL, 0xA3},
+            {KEY_LEFTALT, 0xA4}, {KEY_RIGHTALT, 0xA5},
+            {KEY_LEFTBRACE, 0xDB}, {KEY_RIGHTBRACE, 0xDD}, {KEY_SLASH, 0xBF}, {KEY_SEMICOLON, 0xBA},
+            {0xBF, KEY_SLASH},      // /
+            {0xBA, KEY_SEMICOLON},  // ; or :
+            {0x31, KEY_1},          // 1
+            {0x32, KEY_2},          // 2
+            {0x33, KEY_3},          // 3
+            {0x34, KEY_4},          // 4
+            {0x35, KEY_5},          // 5
+            {0x36, KEY_6},          // 6
+            {0x37, KEY_7},          // 7
+            {0x38, KEY_8},          // 8
+            {0x39, KEY_9},          // 9
+            {0x30, KEY_0},          // 0
+            {0xBD, KEY_MINUS},      // - or _
+            {0xBB, KEY_EQUAL},      // = or +
+            {0xDC, KEY_BACKSLASH},  // \ or |
+            {0xDE, KEY_APOSTROPHE}, // ' or "
+            {0xBC, KEY_COMMA},      // , or <
+            {0xBE, KEY_DOT},        // . or >
+            {0xC0, KEY_GRAVE},      // ` or ~
+            // Navigation keys
+            {KEY_HOME, 0x24}, {KEY_END, 0x23}, {KEY_PAGEUP, 0x21}, {KEY_PAGEDOWN, 0x22},
+            // Numpad
+            {KEY_KP0, 0x60}, {KEY_KP1, 0x61}, {KEY_KP2, 0x62}, {KEY_KP3, 0x63},
+            {KEY_KP4, 0x64}, {KEY_KP5, 0x65}, {KEY_KP6, 0x66}, {KEY_KP7, 0x67},
+            {KEY_KP8, 0x68}, {KEY_KP9, 0x69},
+            {KEY_KPASTERISK, 0x6A}, {KEY_KPPLUS, 0x6B}, {KEY_KPMINUS, 0x6D},
+            {KEY_KPDOT, 0x6E}, {KEY_KPSLASH, 0x6F},
+            // Lock keys
+            {KEY_CAPSLOCK, 0x14}, {KEY_NUMLOCK, 0x90}, {KEY_SCROLLLOCK, 0x91},
+            // System keys
+            {KEY_SYSRQ, 0x2C}, {KEY_PAUSE, 0x13},
+            // Windows/Super key
+            {KEY_LEFTMETA, 0x5B}, {KEY_RIGHTMETA, 0x5C},
+            // Arrow keys (if not already there)
+            {KEY_LEFT, 0x25}, {KEY_UP, 0x26}, {KEY_RIGHT, 0x27}, {KEY_DOWN, 0x28},
+            // Backspace, Delete, Insert (if not already there)
+            {KEY_BACKSPACE, 0x08}, {KEY_DELETE, 0x2E}, {KEY_INSERT, 0x2D},
+
+        };
+        
+
+        if (evdevToVk.count(evdevCode)) {
+            return evdevToVk[evdevCode];
+        }
+        return evdevCode;
+    }
+
+    
+    Key getCurrentPressedKeyLinux(int timeout_ms) {
+        auto startTime = std::chrono::steady_clock::now();
+        
+        do {
+            unsigned int pressedKeyCode = 0;
+            bool keyFound = false;
+            
+            // Check for pressed keys in a scoped lock
+            {
+                std::lock_guard<std::mutex> lock(m_keyMutex);
+                
+                // Find the first pressed key
+                for (const auto& pair : m_keyStates) {
+                    if (pair.second) {
+                        pressedKeyCode = pair.first;
+                        keyFound = true;
+                        break;
+                    }
+                }
+            } // Lock is released here
+            
+            // If we found a pressed key, wait for it to be released
+            if (keyFound) {
+                bool released = false;
+                while (!released) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                    
+                    // Check if key is still pressed
+                    std::lock_guard<std::mutex> lock(m_keyMutex);
+                    auto it = m_keyStates.find(pressedKeyCode);
+                    released = (it == m_keyStates.end() || !it->second);
+                }
+                
+                return static_cast<Key>(pressedKeyCode);
+            }
+            
+            if (timeout_ms == 0) {
+                break; // No wait, check once
+            }
+            
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            
+            if (timeout_ms > 0) {
+                auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now() - startTime
+                ).count();
+                if (elapsed >= timeout_ms) {
+                    break;
+                }
+            }
+            
+        } while (timeout_ms != 0);
+        
+        return static_cast<Key>(0); // No key pressed
+    }
+
+#endif
+
+    // Queue a full click as two reports
+    void queueClick(EventBatch& batch, Key button) {
+        queueButton(batch, button, true);
+        endReport(batch);
+        queueButton(batch, button, false);
+        endReport(batch);
+    }
+
+    // Queue a key or mouse button edge into the open report
+    void queueKey(EventBatch& batch, Key key, bool down) {
+        if (isMouseButton(key)) {
+            queueButton(batch, key, down);
+            return;
+        }
+#ifdef _WIN32
+        batch.inputs.push_back(keyInputWindows(static_cast<unsigned int>(key), !down));
+#else
+        batch.add(EV_KEY, toEvdevCode(static_cast<unsigned int>(key)), down ? 1 : 0);
+#endif
+    }
+
+    // Shared driver of moveMousePath(): samples `position` at the curve-eased
+    // time of each tick and sends the whole-pixel change since the last one
+    TaskId startMousePath(int dx, int dy, int durationMs, PathCurve curve, int rateHz,
+                          std::function<void(double, double&, double&)> position) {
+        rateHz = std::max(1, std::min(rateHz, 1000));
+        struct PathState {
+            int samples;
+            int sample = 0;
+            long sentX = 0, sentY = 0;
+        };
+        auto state = std::make_shared<PathState>();
+        state->samples = std::max(1, static_cast<int>(static_cast<long long>(durationMs) * rateHz / 1000));
+        auto period = std::chrono::duration_cast<SchedClock::duration>(
+            std::chrono::duration<double>(1.0 / rateHz));
+        
+        auto run = [this, dx, dy, curve, state, period, position]
+                   (SchedClock::time_point& due, EventBatch& batch) {
+            state->sample++;
+            double x, y;
+            if (state->sample >= state->samples) {
+                x = dx;  // land exactly on the target
+                y = dy;
+            } else {
+                position(applyCurve(curve, static_cast<double>(state->sample) / state->samples), x, y);
+            }
+            long stepX = std::lround(x) - state->sentX;
+            long stepY = std::lround(y) - state->sentY;
+            if (stepX || stepY) {
+                queueMove(batch, static_cast<int>(stepX), static_cast<int>(stepY));
+                state->sentX += stepX;
+                state->sentY += stepY;
+            }
+            due += period;
+            return state->sample < state->samples;
+        };
+        return scheduleTask(SchedClock::now() + period, run);
+    }
+
+    // ==================== SCHEDULER ====================
+    // One thread runs every timed action at absolute steady_clock deadlines.
+    // Tasks queue their output into a shared batch that is flushed once per
+    // wakeup, so actions falling due together share a single write.
+    using SchedClock = std::chrono::steady_clock;
+
+    struct ScheduledTask {
+        // Called at the deadline; moves `due` forward and returns true to run
+        // again, or returns false when finished. Motion may be left in the
+        // open report so it merges with other tasks due at the same time.
+        std::function<bool(SchedClock::time_point& due, EventBatch& batch)> run;
+        // Called instead of run() once the task is cancelled
+        std::function<void(EventBatch& batch)> onStop;
+        bool cancelled = false;
+        // Deadline of the live heap entry; others for this task are stale
+        SchedClock::time_point due;
+        bool keyWaiting = false;  // registered in m_keyWaiters
+        bool keyWoken = false;    // resumed by the awaited key edge
+    };
+
+    // `due` of a task that only resumes on a key edge (see awaitKey)
+    static constexpr SchedClock::time_point kTaskParked = SchedClock::time_point::max();
+
+    // Periodic tasks and waits step on from the time their tick was due, so
+    // small delays are caught up. A tick running later than kMaxTickLag
+    // counts as due now: after a stall the cadence restarts instead of
+    // bursting through the ticks that were missed.
+    static constexpr std::chrono::milliseconds kMaxTickLag{20};
+
+    static SchedClock::time_point catchUp(SchedClock::time_point tick, SchedClock::time_point now) {
+        return tick < now - kMaxTickLag ? now : tick;
+    }
+
+    // A task parked until a key reaches a state
+    struct KeyWaiter {
+        TaskId task;
+        unsigned int key;
+        bool down;
+    };
+
+    struct AutoclickState {
+        std::mutex mutex;
+        double targetCps = 0.0;
+        SchedClock::duration interval{};
+        uint64_t clicks = 0;
+        SchedClock::time_point first, last;
+        double meanNs = 0.0, m2 = 0.0, maxErrorNs = 0.0;  // Welford over intervals
+
+        void recordClick(SchedClock::time_point now) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (clicks++ == 0) {
+                first = last = now;
+                return;
+            }
+            double ns = std::chrono::duration<double, std::nano>(now - last).count();
+            last = now;
+            uint64_t n = clicks - 1;
+            double delta = ns - meanNs;
+            meanNs += delta / n;
+            m2 += delta * (ns - meanNs);
+            double error = std::abs(ns - std::chrono::duration<double, std::nano>(interval).count());
+            if (error > maxErrorNs) maxErrorNs = error;
+        }
+
+        AutoclickStats stats() {
+            std::lock_guard<std::mutex> lock(mutex);
+            AutoclickStats st;
+            st.clicks = clicks;
+            st.targetCps = targetCps;
+            if (clicks > 1) {
+                double seconds = std::chrono::duration<double>(last - first).count();
+                st.achievedCps = seconds > 0 ? (clicks - 1) / seconds : 0.0;
+                st.intervalJitterUs = std::sqrt(m2 / (clicks - 1)) / 1000.0;
+                st.maxIntervalErrorUs = maxErrorNs / 1000.0;
+            }
+            return st;
+        }
+    };
+
+#ifndef _WIN32
+    // Scheduler thread only, apart from the atomic counters
+    struct ReplayState {
+        explicit ReplayState(const std::string& path) : reader(path) {}
+        RecordingReader reader;
+        double speed = 1.0;
+        bool loop = false;
+        uint64_t fromNs = 0, toNs = 0;  // absolute recording times
+        SchedClock::time_point origin;  // when fromNs plays
+        SchedClock::duration loopPeriod{};
+        RecordedEvent pending{};
+        bool havePending = false;
+        std::vector<bool> held = std::vector<bool>(KEY_CNT);
+        std::atomic<uint64_t> events{0}, reports{0}, loops{0};
+        LatencyRecorder timingError;
+    };
+
+    SchedClock::time_point replayDeadline(const ReplayState& state, uint64_t timeNs) {
+        return state.origin + std::chrono::duration_cast<SchedClock::duration>(
+            std::chrono::duration<double, std::nano>((timeNs - state.fromNs) / state.speed));
+    }
+
+    static ReplayStats replayStats(ReplayState& state) {
+        ReplayStats stats;
+        stats.events = state.events.load();
+        stats.reports = state.reports.load();
+        stats.loops = state.loops.load();
+        stats.timingError = state.timingError.snapshot();
+        return stats;
+    }
+
+    void releaseReplayHeld(ReplayState& state, EventBatch& batch) {
+        bool any = false;
+        for (size_t code = 0; code < state.held.size(); ++code) {
+            if (!state.held[code]) continue;
+            batch.add(EV_KEY, static_cast<int>(code), 0);
+            state.held[code] = false;
+            any = true;
+        }
+        if (any) endReport(batch);
+    }
+
+    // Emit every timestamp group that is due, then sleep until the next one
+    bool replayStep(ReplayState& state, SchedClock::time_point& due, EventBatch& batch) {
+        auto now = SchedClock::now();
+        while (true) {
+            if (!state.havePending) {
+                if (!state.loop) {
+                    releaseReplayHeld(state, batch);
+                    return false;
+                }
+                releaseReplayHeld(state, batch);
+                state.reader.seek(state.fromNs);
+                state.havePending = state.reader.next(state.pending);
+                state.origin += state.loopPeriod;
+                state.loops.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
             
-            // Uppercase letters
-            {'A', {KEY_A, true}}, {'B', {KEY_B, true}}, {'C', {KEY_C, true}},
-            {'D', {KEY_D, true}}, {'E', {KEY_E, true}}, {'F', {KEY_F, true}},
-            {'G', {KEY_G, true}}, {'H', {KEY_H, true}}, {'I', {KEY_I, true}},
-            {'J', {KEY_J, true}}, {'K', {KEY_K, true}}, {'L', {KEY_L, true}},
-            {'M', {KEY_M, true}}, {'N', {KEY_N, true}}, {'O', {KEY_O, true}},
-            {'P', {KEY_P, true}}, {'Q', {KEY_Q, true}}, {'R', {KEY_R, true}},
-            {'S', {KEY_S, true}}, {'T', {KEY_T, true}}, {'U', {KEY_U, true}},
-            {'V', {KEY_V, true}}, {'W', {KEY_W, true}}, {'X', {KEY_X, true}},
-            {'Y', {KEY_Y, true}}, {'Z', {KEY_Z, true}},
+            auto target = replayDeadline(state, state.pending.timeNs);
+            if (target > now) {
+                due = target;
+                return true;
+            }
             
-            // Numbers
-            {'0', {KEY_0, false}}, {'1', {KEY_1, false}}, {'2', {KEY_2, false}},
-            {'3', {KEY_3, false}}, {'4', {KEY_4, false}}, {'5', {KEY_5, false}},
-            {'6', {KEY_6, false}}, {'7', {KEY_7, false}}, {'8', {KEY_8, false}},
-            {'9', {KEY_9, false}},
+            uint64_t groupNs = state.pending.timeNs;
+            uint64_t lateNs = std::chrono::duration_cast<std::chrono::nanoseconds>(now - target).count();
+            while (state.havePending && state.pending.timeNs == groupNs) {
+                const RecordedEvent& ev = state.pending;
+                if (ev.type == EV_REL) {
+                    batch.rel(ev.code, ev.value);
+                } else if (ev.type != EV_SYN) {
+                    batch.add(ev.type, ev.code, ev.value);
+                    if (ev.type == EV_KEY && ev.code < state.held.size() && ev.value != 2) {
+                        state.held[ev.code] = ev.value != 0;
+                    }
+                }
+                state.timingError.record(lateNs);
+                state.events.fetch_add(1, std::memory_order_relaxed);
+                state.havePending = state.reader.next(state.pending) && state.pending.timeNs <= state.toNs;
+            }
+            endReport(batch);
+            state.reports.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+#endif
+
+    // Bytes of operands after the opcode at `pc`, or SIZE_MAX if unknown
+    static size_t macroOperandBytes(const MacroCode& code, size_t pc) {
+        switch (static_cast<MacroOp>(code[pc])) {
+            case MacroOp::End: return 0;
+            case MacroOp::Press:
+            case MacroOp::Release:
+            case MacroOp::Tap:
+            case MacroOp::Repeat: return 2;
+            case MacroOp::Chord: return pc + 1 < code.size() ? 1 + 2 * code[pc + 1] : 1;
+            case MacroOp::Move: return 8;
+            case MacroOp::Wait:
+            case MacroOp::Next:
+            case MacroOp::Jump: return 4;
+            case MacroOp::WaitKey:
+            case MacroOp::IfKey: return 7;
+            case MacroOp::Reports:
+                return pc + 2 < code.size() ? 2 + 2 * static_cast<size_t>(readMacro<uint16_t>(code, pc + 1)) : 2;
+        }
+        return SIZE_MAX;
+    }
+
+    template<typename T>
+    static T readMacro(const MacroCode& code, size_t at) {
+        T value;
+        memcpy(&value, &code[at], sizeof(T));
+        return value;
+    }
+
+    // Scheduler thread only
+    struct MacroState {
+        std::shared_ptr<const MacroCode> code;
+        size_t pc = 0;
+        uint16_t loops[kMacroLoopDepth] = {};
+        int loopDepth = 0;
+        bool waiting = false;  // inside a WaitKey
+        SchedClock::time_point waitUntil;
+        std::vector<uint16_t> held;
+    };
+
+    // Instructions run per wakeup before a macro with no waits yields
+    static constexpr int kMacroStepBudget = 4096;
+
+    void setMacroKey(MacroState& state, EventBatch& batch, uint16_t key, bool down) {
+        auto it = std::find(state.held.begin(), state.held.end(), key);
+        if (down && it == state.held.end()) state.held.push_back(key);
+        if (!down && it != state.held.end()) state.held.erase(it);
+        queueKey(batch, static_cast<Key>(key), down);
+    }
+
+    void releaseMacroKeys(MacroState& state, EventBatch& batch) {
+        for (auto it = state.held.rbegin(); it != state.held.rend(); ++it) {
+            queueKey(batch, static_cast<Key>(*it), false);
+        }
+        if (!state.held.empty()) endReport(batch);
+        state.held.clear();
+    }
+
+#ifdef INPCTRL_COROUTINES
+    void queueCoKey(CoMacro::promise_type& promise, Key key, int action) {
+        EventBatch& batch = *promise.batch;
+        if (action == 2) {
+            queueKey(batch, key, true);
+            endReport(batch);
+            queueKey(batch, key, false);
+            endReport(batch);
+            return;
+        }
+        auto it = std::find(promise.held.begin(), promise.held.end(), key);
+        if (action == 1 && it == promise.held.end()) promise.held.push_back(key);
+        if (action == 0 && it != promise.held.end()) promise.held.erase(it);
+        queueKey(batch, key, action == 1);
+        endReport(batch);
+    }
+
+    void releaseCoKeys(CoMacro::promise_type& promise, EventBatch& batch) {
+        for (auto it = promise.held.rbegin(); it != promise.held.rend(); ++it) {
+            queueKey(batch, *it, false);
+        }
+        if (!promise.held.empty()) endReport(batch);
+        promise.held.clear();
+    }
+#endif
+
+    // Interpret until the macro waits or ends
+    bool runMacroStep(MacroState& state, SchedClock::time_point& due, EventBatch& batch) {
+        const MacroCode& code = *state.code;
+        for (int budget = kMacroStepBudget; budget > 0; --budget) {
+            size_t pc = state.pc;
+            MacroOp op = static_cast<MacroOp>(code[pc]);
+            state.pc = pc + 1 + macroOperandBytes(code, pc);
+            switch (op) {
+                case MacroOp::End:
+                    endReport(batch);
+                    return false;
+                case MacroOp::Press:
+                case MacroOp::Release:
+                    setMacroKey(state, batch, readMacro<uint16_t>(code, pc + 1), op == MacroOp::Press);
+                    endReport(batch);
+                    break;
+                case MacroOp::Tap: {
+                    uint16_t key = readMacro<uint16_t>(code, pc + 1);
+                    queueKey(batch, static_cast<Key>(key), true);
+                    endReport(batch);
+                    queueKey(batch, static_cast<Key>(key), false);
+                    endReport(batch);
+                    break;
+                }
+                case MacroOp::Chord: {
+                    int n = code[pc + 1];
+                    for (int i = 0; i < n; ++i) {
+                        queueKey(batch, static_cast<Key>(readMacro<uint16_t>(code, pc + 2 + 2 * i)), true);
+                    }
+                    endReport(batch);
+                    for (int i = n - 1; i >= 0; --i) {
+                        queueKey(batch, static_cast<Key>(readMacro<uint16_t>(code, pc + 2 + 2 * i)), false);
+                    }
+                    endReport(batch);
+                    break;
+                }
+                case MacroOp::Move:
+                    queueMove(batch, readMacro<int32_t>(code, pc + 1), readMacro<int32_t>(code, pc + 5));
+                    break;
+                case MacroOp::Wait: {
+                    due = catchUp(due, SchedClock::now()) +
+                          std::chrono::microseconds(readMacro<uint32_t>(code, pc + 1));
+                    return true;
+                }
+                case MacroOp::Repeat:
+                    if (state.loopDepth == kMacroLoopDepth) {
+                        std::cerr << "Macro loops nested too deep" << std::endl;
+                        releaseMacroKeys(state, batch);
+                        return false;
+                    }
+                    state.loops[state.loopDepth++] = readMacro<uint16_t>(code, pc + 1);
+                    break;
+                case MacroOp::Next:
+                    if (state.loopDepth == 0) break;
+                    if (state.loops[state.loopDepth - 1] == 0 || --state.loops[state.loopDepth - 1] > 0) {
+                        state.pc = readMacro<uint32_t>(code, pc + 1);
+                    } else {
+                        state.loopDepth--;
+                    }
+                    break;
+                case MacroOp::WaitKey: {
+                    Key key = static_cast<Key>(readMacro<uint16_t>(code, pc + 1));
+                    bool down = code[pc + 3] != 0;
+                    uint32_t timeoutMs = readMacro<uint32_t>(code, pc + 4);
+                    auto now = SchedClock::now();
+                    if (!state.waiting) {
+                        state.waitUntil = timeoutMs ? now + std::chrono::milliseconds(timeoutMs) : kTaskParked;
+                    } else if (resumedByKey() || now >= state.waitUntil) {
+                        state.waiting = false;
+                        break;
+                    }
+                    // Park on the key edge; only the timeout takes a heap entry
+                    due = state.waitUntil;
+                    if (awaitKey(key, down, due)) {
+                        state.waiting = false;
+                        break;
+                    }
+                    state.waiting = true;
+                    state.pc = pc;
+                    endReport(batch);
+                    return true;
+                }
+                case MacroOp::IfKey:
+                    if (isKeyPressed(static_cast<Key>(readMacro<uint16_t>(code, pc + 1))) != (code[pc + 3] != 0)) {
+                        state.pc = readMacro<uint32_t>(code, pc + 4);
+                    }
+                    break;
+                case MacroOp::Jump:
+                    state.pc = readMacro<uint32_t>(code, pc + 1);
+                    break;
+                case MacroOp::Reports: {
+                    int n = readMacro<uint16_t>(code, pc + 1);
+                    for (int i = 0; i < n; ++i) {
+                        uint16_t edge = readMacro<uint16_t>(code, pc + 3 + 2 * i);
+                        setMacroKey(state, batch, edge & 0xFF, (edge & 0x100) != 0);
+                        if (edge & 0x200) endReport(batch);
+                    }
+                    break;
+                }
+            }
+        }
+        // Busy macro without waits: let other tasks run, then carry on
+        endReport(batch);
+        due = SchedClock::now();
+        return true;
+    }
+
+    struct MacroKeyName {
+        const char* name;  // lower case, table sorted by it
+        Key key;
+    };
+
+    static char asciiLower(char c) {
+        return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+    }
+
+    // Case-insensitive binary search over a static table, no allocation
+    static bool macroKeyFromName(std::string_view name, Key& key) {
+        static constexpr MacroKeyName names[] = {
+        {"0", Key::Num0}, {"1", Key::Num1}, {"2", Key::Num2}, {"3", Key::Num3}, {"4", Key::Num4},
+        {"5", Key::Num5}, {"6", Key::Num6}, {"7", Key::Num7}, {"8", Key::Num8}, {"9", Key::Num9},
+        {"a", Key::A}, {"alt", Key::LAlt}, {"ampersand", Key::Ampersand},
+        {"asterisk", Key::Asterisk}, {"at", Key::At}, {"az_at", Key::AZ_At},
+        {"az_colon", Key::AZ_Colon}, {"az_exclamation", Key::AZ_Exclamation},
+        {"az_hash", Key::AZ_Hash}, {"az_slash", Key::AZ_Slash}, {"b", Key::B},
+        {"backslash", Key::Backslash}, {"backspace", Key::Backspace}, {"c", Key::C},
+        {"capslock", Key::CapsLock}, {"caret", Key::Caret}, {"colon", Key::Colon},
+        {"comma", Key::Comma}, {"ctrl", Key::LCtrl}, {"d", Key::D}, {"delete", Key::Delete},
+        {"dollar", Key::Dollar}, {"dot", Key::Dot}, {"doublequote", Key::DoubleQuote},
+        {"down", Key::Down}, {"e", Key::E}, {"end", Key::End}, {"enter", Key::Enter},
+        {"equal", Key::Equal}, {"esc", Key::Escape}, {"escape", Key::Escape},
+        {"exclamation", Key::Exclamation}, {"f", Key::F}, {"f1", Key::F1}, {"f10", Key::F10},
+        {"f11", Key::F11}, {"f12", Key::F12}, {"f2", Key::F2}, {"f3", Key::F3}, {"f4", Key::F4},
+        {"f5", Key::F5}, {"f6", Key::F6}, {"f7", Key::F7}, {"f8", Key::F8}, {"f9", Key::F9},
+        {"g", Key::G}, {"grave", Key::Grave}, {"greater", Key::Greater}, {"h", Key::H},
+        {"hash", Key::Hash}, {"home", Key::Home}, {"i", Key::I}, {"insert", Key::Insert},
+        {"j", Key::J}, {"k", Key::K}, {"l", Key::L}, {"lalt", Key::LAlt}, {"lctrl", Key::LCtrl},
+        {"left", Key::Left}, {"leftbracket", Key::LeftBracket}, {"leftparen", Key::LeftParen},
+        {"less", Key::Less}, {"lmb", Key::LMB}, {"lshift", Key::LShift}, {"lwin", Key::LWin},
+        {"m", Key::M}, {"minus", Key::Minus}, {"mmb", Key::MMB}, {"mouse4", Key::Mouse4},
+        {"mouse5", Key::Mouse5}, {"n", Key::N}, {"num0", Key::Num0}, {"num1", Key::Num1},
+        {"num2", Key::Num2}, {"num3", Key::Num3}, {"num4", Key::Num4}, {"num5", Key::Num5},
+        {"num6", Key::Num6}, {"num7", Key::Num7}, {"num8", Key::Num8}, {"num9", Key::Num9},
+        {"numlock", Key::NumLock}, {"numpad0", Key::Numpad0}, {"numpad1", Key::Numpad1},
+        {"numpad2", Key::Numpad2}, {"numpad3", Key::Numpad3}, {"numpad4", Key::Numpad4},
+        {"numpad5", Key::Numpad5}, {"numpad6", Key::Numpad6}, {"numpad7", Key::Numpad7},
+        {"numpad8", Key::Numpad8}, {"numpad9", Key::Numpad9}, {"numpadadd", Key::NumpadAdd},
+        {"numpaddecimal", Key::NumpadDecimal}, {"numpaddivide", Key::NumpadDivide},
+        {"numpadmultiply", Key::NumpadMultiply}, {"numpadsubtract", Key::NumpadSubtract},
+        {"o", Key::O}, {"p", Key::P}, {"pagedown", Key::PageDown}, {"pageup", Key::PageUp},
+        {"pause", Key::Pause}, {"percent", Key::Percent}, {"pipe", Key::Pipe}, {"plus", Key::Plus},
+        {"printscreen", Key::PrintScreen}, {"q", Key::Q}, {"quote", Key::Quote}, {"r", Key::R},
+        {"ralt", Key::RAlt}, {"rctrl", Key::RCtrl}, {"return", Key::Enter}, {"right", Key::Right},
+        {"rightbracket", Key::RightBracket}, {"rightparen", Key::RightParen}, {"rmb", Key::RMB},
+        {"rshift", Key::RShift}, {"rwin", Key::RWin}, {"s", Key::S},
+        {"scrolllock", Key::ScrollLock}, {"semicolon", Key::Semicolon}, {"shift", Key::LShift},
+        {"slash", Key::Slash}, {"space", Key::Space}, {"t", Key::T}, {"tab", Key::Tab},
+        {"tilde", Key::Tilde}, {"u", Key::U}, {"underscore", Key::Underscore}, {"up", Key::Up},
+        {"v", Key::V}, {"w", Key::W}, {"win", Key::LWin}, {"x", Key::X}, {"y", Key::Y},
+        {"z", Key::Z},
+        };
+        // Compare a table name with `name` as if it were lower case
+        auto less = [](const MacroKeyName& entry, std::string_view n) {
+            size_t i = 0;
+            for (; entry.name[i] && i < n.size(); ++i) {
+                char c = asciiLower(n[i]);
+                if (entry.name[i] != c) return static_cast<unsigned char>(entry.name[i]) < static_cast<unsigned char>(c);
+            }
+            return entry.name[i] == '\0' && i < n.size();
+        };
+        auto it = std::lower_bound(std::begin(names), std::end(names), name, less);
+        if (it == std::end(names) || strlen(it->name) != name.size()) return false;
+        for (size_t i = 0; i < name.size(); ++i) {
+            if (it->name[i] != asciiLower(name[i])) return false;
+        }
+        key = it->key;
+        return true;
+    }
+
+    // Single pass recursive descent compiler behind compileMacro()
+    class MacroCompiler {
+    public:
+        explicit MacroCompiler(std::string_view source) : m_src(source) {}
+
+        const std::string& error() const { return m_error; }
+
+        bool compileMacro(MacroCode& code) {
+            MacroBuilder builder;
+            bool timed = false;
+            if (!block(builder, false, timed)) return false;
+            code = builder.build();
+            return true;
+        }
+
+        bool compileLibrary(std::unordered_map<std::string, MacroCode>& macros) {
+            while (true) {
+                skipSeparators();
+                std::string_view word = next();
+                if (word.empty()) return true;
+                if (!is(word, "macro")) return fail("expected 'macro', got '" + std::string(word) + "'");
+                std::string_view name = next();
+                if (name.empty() || !isWord(name)) return fail("expected a macro name");
+                skipSeparators();
+                if (next() != "{") return fail("expected '{' after macro name");
+                
+                MacroBuilder builder;
+                bool timed = false;
+                if (!block(builder, true, timed)) return false;
+                if (!macros.emplace(std::string(name), builder.build()).second) {
+                    return fail("macro '" + std::string(name) + "' defined twice");
+                }
+            }
+        }
+
+    private:
+        static constexpr uint64_t kMaxWaitUs = 3600ULL * 1000000;
+        static constexpr int kMaxMoveSteps = 10000;
+        static constexpr int kMaxBlockDepth = 64;  // bounds the recursion
+
+        std::string_view m_src;
+        size_t m_pos = 0;
+        int m_line = 1;
+        std::string m_error;
+        std::vector<MacroEdge> m_edges;  // key statements not yet emitted
+        int m_loops = 0;                 // loops open around the statement
+        int m_blocks = 0;
+
+        bool fail(const std::string& what) {
+            if (m_error.empty()) m_error = "line " + std::to_string(m_line) + ": " + what;
+            return false;
+        }
+
+        static bool is(std::string_view word, const char* keyword) {
+            size_t i = 0;
+            for (; keyword[i]; ++i) {
+                if (i >= word.size() || asciiLower(word[i]) != keyword[i]) return false;
+            }
+            return i == word.size();
+        }
+
+        static bool isWord(std::string_view token) {
+            return !token.empty() && token != "\n" && token != ";" && token != "{" &&
+                   token != "}" && token != ",";
+        }
+
+        // `xN`, `x N` or `every DUR` after tap and click, so that a bare
+        // `click x5` means the left button rather than a key named x5
+        static bool isRepeatOption(std::string_view token) {
+            if (is(token, "every") || is(token, "x")) return true;
+            if (token.size() < 2 || asciiLower(token[0]) != 'x') return false;
+            for (char c : token.substr(1)) {
+                if (c < '0' || c > '9') return false;
+            }
+            return true;
+        }
+
+        void skipBlanks() {
+            while (m_pos < m_src.size()) {
+                char c = m_src[m_pos];
+                if (c == ' ' || c == '\t' || c == '\r') {
+                    m_pos++;
+                } else if (c == '#') {
+                    while (m_pos < m_src.size() && m_src[m_pos] != '\n') m_pos++;
+                } else {
+                    break;
+                }
+            }
+        }
+
+        // Next token: a word, one of ; { } , or "\n"; empty at the end
+        std::string_view next() {
+            skipBlanks();
+            if (m_pos >= m_src.size()) return std::string_view();
+            char c = m_src[m_pos];
+            if (c == '\n' || c == ';' || c == '{' || c == '}' || c == ',') {
+                if (c == '\n') m_line++;
+                return m_src.substr(m_pos++, 1);
+            }
+            size_t start = m_pos;
+            while (m_pos < m_src.size()) {
+                c = m_src[m_pos];
+                if (c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == ';' ||
+                    c == '{' || c == '}' || c == ',' || c == '#') break;
+                m_pos++;
+            }
+            return m_src.substr(start, m_pos - start);
+        }
+
+        std::string_view peek() {
+            size_t pos = m_pos;
+            int line = m_line;
+            std::string_view token = next();
+            m_pos = pos;
+            m_line = line;
+            return token;
+        }
+
+        void skipSeparators() {
+            while (peek() == "\n" || peek() == ";") next();
+        }
+
+        bool key(std::string_view word, Key& out) {
+            if (!isWord(word)) return fail("expected a key name");
+            if (!macroKeyFromName(word, out)) return fail("unknown key '" + std::string(word) + "'");
+            return true;
+        }
+
+        bool integer(std::string_view word, long long lo, long long hi, long long& out) {
+            bool negative = !word.empty() && word[0] == '-';
+            if (negative) word.remove_prefix(1);
+            if (word.empty() || word.size() > 18) return fail("expected a number");
+            long long value = 0;
+            for (char c : word) {
+                if (c < '0' || c > '9') return fail("expected a number, got '" + std::string(word) + "'");
+                value = value * 10 + (c - '0');
+            }
+            if (negative) value = -value;
+            if (value < lo || value > hi) {
+                return fail("number " + std::to_string(value) + " outside " +
+                            std::to_string(lo) + ".." + std::to_string(hi));
+            }
+            out = value;
+            return true;
+        }
+
+        // "250ms", "1.5s", "800us" into microseconds, within [minUs, kMaxWaitUs]
+        bool duration(std::string_view word, uint64_t minUs, uint64_t& us) {
+            size_t i = 0;
+            double value = 0.0, scale = 1.0;
+            bool digits = false, fraction = false;
+            for (; i < word.size(); ++i) {
+                char c = word[i];
+                if (c >= '0' && c <= '9') {
+                    digits = true;
+                    if (fraction) {
+                        scale /= 10.0;
+                        value += (c - '0') * scale;
+                    } else {
+                        value = value * 10.0 + (c - '0');
+                    }
+                } else if (c == '.' && !fraction) {
+                    fraction = true;
+                } else {
+                    break;
+                }
+            }
+            std::string_view unit = word.substr(i);
+            double unitUs;
+            if (is(unit, "us")) unitUs = 1.0;
+            else if (is(unit, "ms")) unitUs = 1000.0;
+            else if (is(unit, "s")) unitUs = 1000000.0;
+            else return fail("expected a duration like 200ms, got '" + std::string(word) + "'");
+            if (!digits) return fail("expected a duration like 200ms, got '" + std::string(word) + "'");
             
-            // Shifted numbers (symbols)
-            {'!', {KEY_1, true}}, {'@', {KEY_2, true}}, {'#', {KEY_3, true}},
-            {'$', {KEY_4, true}}, {'%', {KEY_5, true}}, {'^', {KEY_6, true}},
-            {'&', {KEY_7, true}}, {'*', {KEY_8, true}}, {'(', {KEY_9, true}},
-            {')', {KEY_0, true}},
+            double total = value * unitUs;
+            if (total < static_cast<double>(minUs) || total > static_cast<double>(kMaxWaitUs)) {
+                return fail("duration '" + std::string(word) + "' must be between " +
+                            std::to_string(minUs) + "us and 1 hour");
+            }
+            us = static_cast<uint64_t>(std::llround(total));
+            return true;
+        }
+
+        void flushEdges(MacroBuilder& builder) {
+            if (m_edges.empty()) return;
+            builder.reports(m_edges);
+            m_edges.clear();
+        }
+
+        // Statements up to the closing brace (nested) or the end of input.
+        // `timed` is set if anything in the block waits.
+        bool block(MacroBuilder& builder, bool nested, bool& timed) {
+            if (m_blocks == kMaxBlockDepth) return fail("blocks nested too deep");
+            m_blocks++;
+            bool ok = blockBody(builder, nested, timed);
+            m_blocks--;
+            return ok;
+        }
+
+        // The runner keeps a fixed stack of loop counters
+        bool openLoop(MacroBuilder& builder, int count) {
+            if (m_loops == kMacroLoopDepth) {
+                return fail("loops nested deeper than " + std::to_string(kMacroLoopDepth) +
+                            " (tap ... every counts as one)");
+            }
+            m_loops++;
+            builder.loop(count);
+            return true;
+        }
+
+        void closeLoop(MacroBuilder& builder) {
+            m_loops--;
+            builder.endLoop();
+        }
+
+        bool blockBody(MacroBuilder& builder, bool nested, bool& timed) {
+            while (true) {
+                skipSeparators();
+                std::string_view word = next();
+                if (word.empty()) {
+                    if (nested) return fail("missing '}'");
+                    flushEdges(builder);
+                    return true;
+                }
+                if (word == "}") {
+                    if (!nested) return fail("unexpected '}'");
+                    flushEdges(builder);
+                    return true;
+                }
+                if (!statement(builder, word, timed)) return false;
+                
+                std::string_view end = peek();
+                if (!end.empty() && end != "\n" && end != ";" && end != "}") {
+                    return fail("unexpected '" + std::string(end) + "'");
+                }
+            }
+        }
+
+        bool statement(MacroBuilder& builder, std::string_view word, bool& timed) {
+            Key k;
+            if (is(word, "hold") || is(word, "release")) {
+                if (!key(next(), k)) return false;
+                m_edges.push_back({k, is(word, "hold"), true});
+                return true;
+            }
+            if (is(word, "tap") || is(word, "click")) {
+                if (is(word, "click") && (!isWord(peek()) || isRepeatOption(peek()))) {
+                    k = Key::LMB;
+                } else if (!key(next(), k)) {
+                    return false;
+                }
+                long long count = 1;
+                std::string_view option = peek();
+                if (option.size() > 1 && asciiLower(option[0]) == 'x') {
+                    next();
+                    if (!integer(option.substr(1), 1, 0xFFFF, count)) return false;
+                } else if (is(option, "x")) {
+                    next();
+                    if (!integer(next(), 1, 0xFFFF, count)) return false;
+                }
+                if (is(peek(), "every")) {
+                    next();
+                    uint64_t everyUs;
+                    if (!duration(next(), 1000, everyUs)) return false;
+                    m_edges.push_back({k, true, true});
+                    m_edges.push_back({k, false, true});
+                    if (count > 1) {
+                        flushEdges(builder);
+                        if (!openLoop(builder, static_cast<int>(count - 1))) return false;
+                        builder.waitUs(static_cast<uint32_t>(everyUs)).tap(k);
+                        closeLoop(builder);
+                        timed = true;
+                    }
+                    return true;
+                }
+                for (long long i = 0; i < count; ++i) {
+                    m_edges.push_back({k, true, true});
+                    m_edges.push_back({k, false, true});
+                }
+                return true;
+            }
+            if (is(word, "chord")) {
+                std::string_view keys = next();
+                std::vector<Key> chord;
+                while (!keys.empty()) {
+                    size_t plus = keys.find('+');
+                    if (!key(keys.substr(0, plus), k)) return false;
+                    chord.push_back(k);
+                    keys = plus == std::string_view::npos ? std::string_view() : keys.substr(plus + 1);
+                }
+                if (chord.empty() || chord.size() > kMacroChordKeys) {
+                    return fail("a chord takes 1 to " + std::to_string(kMacroChordKeys) + " keys");
+                }
+                for (size_t i = 0; i < chord.size(); ++i) {
+                    m_edges.push_back({chord[i], true, i + 1 == chord.size()});
+                }
+                for (size_t i = chord.size(); i-- > 0;) {
+                    m_edges.push_back({chord[i], false, i == 0});
+                }
+                return true;
+            }
             
-            // Special characters
-            {' ', {KEY_SPACE, false}}, {'\n', {KEY_ENTER, false}}, {'\t', {KEY_TAB, false}},
-            {'-', {KEY_MINUS, false}}, {'_', {KEY_MINUS, true}},
-            {'=', {KEY_EQUAL, false}}, {'+', {KEY_EQUAL, true}},
-            {'[', {KEY_LEFTBRACE, false}}, {'{', {KEY_LEFTBRACE, true}},
-            {']', {KEY_RIGHTBRACE, false}}, {'}', {KEY_RIGHTBRACE, true}},
-            {'\\', {KEY_BACKSLASH, false}}, {'|', {KEY_BACKSLASH, true}},
-            {';', {KEY_SEMICOLON, false}}, {':', {KEY_SEMICOLON, true}},
-            {'\'', {KEY_APOSTROPHE, false}}, {'"', {KEY_APOSTROPHE, true}},
-            {',', {KEY_COMMA, false}}, {'<', {KEY_COMMA, true}},
-            {'.', {KEY_DOT, false}}, {'>', {KEY_DOT, true}},
-            {'/', {KEY_SLASH, false}}, {'?', {KEY_SLASH, true}},
-            {'`', {KEY_GRAVE, false}}, {'~', {KEY_GRAVE, true}},
-            {'/', {KEY_SLASH, false}}, {':', {KEY_SEMICOLON, true}},
-            {'!', {KEY_1, true}}, {'@', {KEY_2, true}}, {'#', {KEY_3, true}},
-            {'$', {KEY_4, true}}, {'%', {KEY_5, true}}, {'^', {KEY_6, true}},
-            {'&', {KEY_7, true}}, {'*', {KEY_8, true}}, {'(', {KEY_9, true}},
-            {')', {KEY_0, true}}, {'-', {KEY_MINUS, false}}, {'_', {KEY_MINUS, true}},
-            {'=', {KEY_EQUAL, false}}, {'+', {KEY_EQUAL, true}}, {'\\', {KEY_BACKSLASH, false}},
-            {'|', {KEY_BACKSLASH, true}}, {';', {KEY_SEMICOLON, false}}, {':', {KEY_SEMICOLON, true}},
-            {'\'', {KEY_APOSTROPHE, false}}, {'"', {KEY_APOSTROPHE, true}}, {',', {KEY_COMMA, false}},
-            {'<', {KEY_COMMA, true}}, {'.', {KEY_DOT, false}}, {'>', {KEY_DOT, true}},
-            {'`', {KEY_GRAVE, false}}, {'~', {KEY_GRAVE, true}}
+            // Everything below is emitted after the pending key edges
+            flushEdges(builder);
+            if (is(word, "wait")) {
+                uint64_t us;
+                if (!duration(next(), 1, us)) return false;
+                builder.waitUs(static_cast<uint32_t>(us));
+                timed = true;
+                return true;
+            }
+            if (is(word, "move")) {
+                long long dx, dy;
+                if (!integer(next(), INT_MIN, INT_MAX, dx)) return false;
+                if (next() != ",") return fail("expected 'move DX,DY'");
+                if (!integer(next(), INT_MIN, INT_MAX, dy)) return false;
+                if (!is(peek(), "over")) {
+                    builder.move(static_cast<int>(dx), static_cast<int>(dy));
+                    return true;
+                }
+                next();
+                uint64_t overUs;
+                if (!duration(next(), 1000, overUs)) return false;
+                long long rate = 125;
+                if (is(peek(), "at")) {
+                    next();
+                    std::string_view hz = next();
+                    if (hz.size() > 2 && is(hz.substr(hz.size() - 2), "hz")) hz.remove_suffix(2);
+                    if (!integer(hz, 1, 1000, rate)) return false;
+                }
+                long long steps = std::max<long long>(1, static_cast<long long>(overUs * rate / 1000000));
+                if (steps > kMaxMoveSteps) {
+                    return fail("move needs " + std::to_string(steps) + " steps, at most " +
+                                std::to_string(kMaxMoveSteps));
+                }
+                // Evenly spaced steps whose sum is exactly (dx, dy)
+                long long sentX = 0, sentY = 0;
+                uint64_t waited = 0;
+                for (long long i = 1; i <= steps; ++i) {
+                    uint64_t at = overUs * i / steps;
+                    builder.waitUs(static_cast<uint32_t>(at - waited));
+                    waited = at;
+                    long long x = std::llround(static_cast<double>(dx) * i / steps);
+                    long long y = std::llround(static_cast<double>(dy) * i / steps);
+                    if (x != sentX || y != sentY) {
+                        builder.move(static_cast<int>(x - sentX), static_cast<int>(y - sentY));
+                    }
+                    sentX = x;
+                    sentY = y;
+                }
+                timed = true;
+                return true;
+            }
+            if (is(word, "waitkey")) {
+                if (!key(next(), k)) return false;
+                bool down = true;
+                if (is(peek(), "up") || is(peek(), "down")) down = is(next(), "down");
+                uint64_t timeoutUs = 0;
+                if (is(peek(), "timeout")) {
+                    next();
+                    if (!duration(next(), 1000, timeoutUs)) return false;
+                }
+                builder.waitKey(k, down, static_cast<int>((timeoutUs + 999) / 1000));
+                timed = true;
+                return true;
+            }
+            if (is(word, "loop")) {
+                long long count = 0;
+                if (peek() != "{" && peek() != "\n") {
+                    if (!integer(next(), 1, 0xFFFF, count)) return false;
+                }
+                skipSeparators();
+                if (next() != "{") return fail("expected '{' after loop");
+                if (!openLoop(builder, static_cast<int>(count))) return false;
+                bool bodyTimed = false;
+                if (!block(builder, true, bodyTimed)) return false;
+                // A forever loop that never waits would monopolise the scheduler
+                if (count == 0 && !bodyTimed) return fail("endless loop needs a wait or waitkey");
+                closeLoop(builder);
+                timed = timed || bodyTimed;
+                return true;
+            }
+            if (is(word, "if")) {
+                if (!key(next(), k)) return false;
+                bool down = true;
+                if (is(peek(), "up") || is(peek(), "down")) down = is(next(), "down");
+                skipSeparators();
+                if (next() != "{") return fail("expected '{' after if");
+                builder.ifKey(k, down);
+                if (!block(builder, true, timed)) return false;
+                
+                // Allow "else" on the next line
+                size_t pos = m_pos;
+                int line = m_line;
+                skipSeparators();
+                if (is(peek(), "else")) {
+                    next();
+                    skipSeparators();
+                    if (next() != "{") return fail("expected '{' after else");
+                    builder.otherwise();
+                    if (!block(builder, true, timed)) return false;
+                } else {
+                    m_pos = pos;
+                    m_line = line;
+                }
+                builder.endIf();
+                return true;
+            }
+            return fail("unknown statement '" + std::string(word) + "'");
+        }
+    };
+
+    // Turbo bindings live under m_turboMutex; the engine task is the only
+    // one touching output state
+    struct TurboBinding {
+        int id = 0;
+        Key trigger = Key::A;
+        Key output = Key::A;
+        TurboTrigger mode = TurboTrigger::Hold;
+        double rateHz = 0.0;
+        double jitter = 0.0;
+        uint32_t rng = 1;
+        bool removed = false;
+        bool triggerDown = false;
+        bool active = false;
+        bool outputDown = false;
+        SchedClock::time_point nextPress, nextRelease, activeSince;
+        uint64_t taps = 0;
+        double activeSeconds = 0.0;
+    };
+
+    // Mouse button triggers are sampled this often on Windows, where the
+    // hook only sees the keyboard
+    static constexpr int kTurboPollUs = 2000;
+
+    std::mutex m_turboMutex;
+    std::vector<std::shared_ptr<TurboBinding>> m_turbo;
+    std::atomic<size_t> m_turboBindings{0};  // lets key edges skip the lock
+    int m_nextTurboId = 1;
+    TaskId m_turboTask = 0;  // the engine, 0 while nothing fires
+    std::vector<Key> m_turboReleases, m_turboPresses;  // engine scratch
+
+    // Interval to the next press, with xorshift jitter
+    static SchedClock::duration turboInterval(TurboBinding& binding) {
+        double seconds = 1.0 / binding.rateHz;
+        if (binding.jitter > 0.0) {
+            binding.rng ^= binding.rng << 13;
+            binding.rng ^= binding.rng >> 17;
+            binding.rng ^= binding.rng << 5;
+            double unit = binding.rng / 4294967295.0 * 2.0 - 1.0;
+            seconds *= 1.0 + binding.jitter * unit;
+        }
+        return std::chrono::duration_cast<SchedClock::duration>(std::chrono::duration<double>(seconds));
+    }
+
+    void setTurboActive(TurboBinding& binding, bool active, SchedClock::time_point now) {
+        if (active == binding.active) return;
+        binding.active = active;
+        if (active) {
+            binding.activeSince = now;
+            binding.nextPress = now;
+        } else {
+            binding.activeSeconds += std::chrono::duration<double>(now - binding.activeSince).count();
+        }
+    }
+
+    // Apply a trigger edge to a binding. Returns whether it started or
+    // stopped firing. Caller holds m_turboMutex.
+    bool applyTurboTrigger(TurboBinding& binding, bool down, SchedClock::time_point now) {
+        if (binding.removed || down == binding.triggerDown) return false;  // autorepeat
+        binding.triggerDown = down;
+        bool active = binding.active;
+        if (binding.mode == TurboTrigger::Hold) {
+            active = down;
+        } else if (down) {
+            active = !active;
+        }
+        if (active == binding.active) return false;
+        setTurboActive(binding, active, now);
+        return true;
+    }
 
-        };
-        
-        auto it = charMap.find(c);
-        if (it == charMap.end()) {
-            std::cerr << "Character '" << c << "' not mapped for Linux" << std::endl;
+    // Called by the listener (or hook) on every physical key edge
+    void turboTriggerEdge(unsigned int key, bool down) {
+        if (m_turboBindings.load(std::memory_order_relaxed) == 0) return;
+        std::lock_guard<std::mutex> lock(m_turboMutex);
+        auto now = SchedClock::now();
+        bool changed = false;
+        for (auto& ptr : m_turbo) {
+            if (static_cast<unsigned int>(ptr->trigger) != key) continue;
+            changed |= applyTurboTrigger(*ptr, down, now);
+        }
+        if (changed) kickTurbo();
+    }
+
+    // Run the engine now, scheduling it if it is idle. Caller holds
+    // m_turboMutex.
+    void kickTurbo() {
+        if (m_turboTask != 0) {
+            wakeTask(m_turboTask);
             return;
         }
+        m_turboTask = scheduleTask(SchedClock::now(),
+                                   [this](SchedClock::time_point& due, EventBatch& batch) { return turboTick(due, batch); },
+                                   [this](EventBatch& batch) { stopTurbo(batch); });
+    }
+
+    // Removed bindings go at once while the engine is idle, since then none
+    // holds its output; otherwise the engine releases and drops them.
+    // Caller holds m_turboMutex.
+    void dropRemovedTurbo() {
+        if (m_turboTask != 0) {
+            kickTurbo();
+            return;
+        }
+        m_turbo.erase(std::remove_if(m_turbo.begin(), m_turbo.end(), [](const std::shared_ptr<TurboBinding>& b) {
+            return b->removed;
+        }), m_turbo.end());
+        m_turboBindings.store(m_turbo.size(), std::memory_order_relaxed);
+    }
+
+    // One pass over every binding: releases due now share one report,
+    // presses due now share the next. The task ends once nothing fires.
+    bool turboTick(SchedClock::time_point& due, EventBatch& batch) {
+        auto now = SchedClock::now();
+        std::lock_guard<std::mutex> lock(m_turboMutex);
+        std::vector<Key>& releases = m_turboReleases;
+        std::vector<Key>& presses = m_turboPresses;
+        releases.clear();
+        presses.clear();
+        bool polling = false;
         
-        KeyMapping mapping = it->second;
-        
-        // Press shift if needed
-        if (mapping.needShift) {
-            holdKeyLinux(KEY_LEFTSHIFT);
+        for (auto& ptr : m_turbo) {
+            TurboBinding& b = *ptr;
+#ifdef _WIN32
+            if (!b.removed && isMouseButton(b.trigger)) {
+                polling = true;
+                applyTurboTrigger(b, isKeyPressed(b.trigger), now);
+            }
+#endif
+            if (b.removed) setTurboActive(b, false, now);
+            
+            if (b.outputDown && (!b.active || now >= b.nextRelease)) {
+                releases.push_back(b.output);
+                b.outputDown = false;
+            }
+            if (b.active && !b.outputDown && now >= b.nextPress) {
+                presses.push_back(b.output);
+                b.outputDown = true;
+                b.taps++;
+                auto interval = turboInterval(b);
+                auto pressed = catchUp(b.nextPress, now);
+                b.nextRelease = pressed + interval / 2;
+                b.nextPress = pressed + interval;
+            }
         }
+        m_turbo.erase(std::remove_if(m_turbo.begin(), m_turbo.end(), [](const std::shared_ptr<TurboBinding>& b) {
+            return b->removed && !b->outputDown;
+        }), m_turbo.end());
+        m_turboBindings.store(m_turbo.size(), std::memory_order_relaxed);
         
-        // Press the key
-        holdKeyLinux(mapping.keyCode);
-        std::this_thread::sleep_for(std::chrono::milliseconds(delayMs));
-        releaseKeyLinux(mapping.keyCode);
+        for (Key key : releases) queueKey(batch, key, false);
+        endReport(batch);
+        for (Key key : presses) queueKey(batch, key, true);
+        endReport(batch);
         
-        // Release shift
-        if (mapping.needShift) {
-            releaseKeyLinux(KEY_LEFTSHIFT);
+        // Inactive bindings were released above, so only active ones remain
+        bool firing = false;
+        due = polling ? now + std::chrono::microseconds(kTurboPollUs) : kTaskParked;
+        for (const auto& ptr : m_turbo) {
+            if (!ptr->active) continue;
+            firing = true;
+            due = std::min(due, ptr->outputDown ? ptr->nextRelease : ptr->nextPress);
         }
+        if (!firing && !polling) {
+            m_turboTask = 0;
+            return false;
+        }
+        return true;
     }
-    
-    // Convert Windows VK codes to evdev codes
-    unsigned int toEvdevCode(unsigned int vkCode) {
-        static std::unordered_map<unsigned int, unsigned int> vkToEvdev = {
-            {0x41, KEY_A}, {0x42, KEY_B}, {0x43, KEY_C}, {0x44, KEY_D},
-            {0x45, KEY_E}, {0x46, KEY_F}, {0x47, KEY_G}, {0x48, KEY_H},
-            {0x49, KEY_I}, {0x4A, KEY_J}, {0x4B, KEY_K}, {0x4C, KEY_L},
-            {0x4D, KEY_M}, {0x4E, KEY_N}, {0x4F, KEY_O}, {0x50, KEY_P},
-            {0x51, KEY_Q}, {0x52, KEY_R}, {0x53, KEY_S}, {0x54, KEY_T},
-            {0x55, KEY_U}, {0x56, KEY_V}, {0x57, KEY_W}, {0x58, KEY_X},
-            {0x59, KEY_Y}, {0x5A, KEY_Z},
-            {0x30, KEY_0}, {0x31, KEY_1}, {0x32, KEY_2}, {0x33, KEY_3},
-            {0x34, KEY_4}, {0x35, KEY_5}, {0x36, KEY_6}, {0x37, KEY_7},
-            {0x38, KEY_8}, {0x39, KEY_9},
-            {0x70, KEY_F1}, {0x71, KEY_F2}, {0x72, KEY_F3}, {0x73, KEY_F4},
-            {0x74, KEY_F5}, {0x75, KEY_F6}, {0x76, KEY_F7}, {0x77, KEY_F8},
-            {0x78, KEY_F9}, {0x79, KEY_F10}, {0x7A, KEY_F11}, {0x7B, KEY_F12},
-            {0x20, KEY_SPACE}, {0x0D, KEY_ENTER}, {0x09, KEY_TAB},
-            {0x1B, KEY_ESC}, {0xA0, KEY_LEFTSHIFT}, {0xA1, KEY_RIGHTSHIFT},
-            {0xA2, KEY_LEFTCTRL}, {0xA3, KEY_RIGHTCTRL},
-            {0xA4, KEY_LEFTALT}, {0xA5, KEY_RIGHTALT},
-            {0xDB, KEY_LEFTBRACE}, {0xDD, KEY_RIGHTBRACE}, {0xBF, KEY_SLASH}, {0xBA, KEY_SEMICOLON}, // QWERTY and AZERTY support
-            {0xBF, KEY_SLASH},      // /
-            {0xBA, KEY_SEMICOLON},  // ; or :
-            {0x31, KEY_1},          // 1
-            {0x32, KEY_2},          // 2
-            {0x33, KEY_3},          // 3
-            {0x34, KEY_4},          // 4
-            {0x35, KEY_5},          // 5
-            {0x36, KEY_6},          // 6
-            {0x37, KEY_7},          // 7
-            {0x38, KEY_8},          // 8
-            {0x39, KEY_9},          // 9
-            {0x30, KEY_0},          // 0
-            {0xBD, KEY_MINUS},      // - or _
-            {0xBB, KEY_EQUAL},      // = or +
-            {0xDC, KEY_BACKSLASH},  // \ or |
-            {0xDE, KEY_APOSTROPHE}, // ' or "
-            {0xBC, KEY_COMMA},      // , or <
-            {0xBE, KEY_DOT},        // . or >
-            {0xC0, KEY_GRAVE},      // ` or ~
-            // Navigation keys
-            {0x24, KEY_HOME}, {0x23, KEY_END}, {0x21, KEY_PAGEUP}, {0x22, KEY_PAGEDOWN},
-            // Numpad
-            {0x60, KEY_KP0}, {0x61, KEY_KP1}, {0x62, KEY_KP2}, {0x63, KEY_KP3},
-            {0x64, KEY_KP4}, {0x65, KEY_KP5}, {0x66, KEY_KP6}, {0x67, KEY_KP7},
-            {0x68, KEY_KP8}, {0x69, KEY_KP9},
-            {0x6A, KEY_KPASTERISK}, {0x6B, KEY_KPPLUS}, {0x6D, KEY_KPMINUS},
-            {0x6E, KEY_KPDOT}, {0x6F, KEY_KPSLASH},
-            // Lock keys
-            {0x14, KEY_CAPSLOCK}, {0x90, KEY_NUMLOCK}, {0x91, KEY_SCROLLLOCK},
-            // System keys
-            {0x2C, KEY_SYSRQ}, {0x13, KEY_PAUSE},
-            // Windows/Super key
-            {0x5B, KEY_LEFTMETA}, {0x5C, KEY_RIGHTMETA},
-            // Arrow keys (if not already there)
-            {0x25, KEY_LEFT}, {0x26, KEY_UP}, {0x27, KEY_RIGHT}, {0x28, KEY_DOWN},
-            // Backspace, Delete, Insert (if not already there)
-            {0x08, KEY_BACKSPACE}, {0x2E, KEY_DELETE}, {0x2D, KEY_INSERT},
 
-        };
+    void stopTurbo(EventBatch& batch) {
+        std::lock_guard<std::mutex> lock(m_turboMutex);
+        auto now = SchedClock::now();
+        for (auto& ptr : m_turbo) {
+            setTurboActive(*ptr, false, now);
+            if (ptr->outputDown) queueKey(batch, ptr->output, false);
+            ptr->outputDown = false;
+        }
+        endReport(batch);
+        m_turboTask = 0;
+    }
+
+#ifndef _WIN32
+    // Injected holds waiting for their next repeat. One task serves all of
+    // them and is only scheduled while something is held. Keys past their
+    // delay repeat together on a shared grid of period-spaced ticks.
+    struct RepeatKey {
+        uint16_t code;
+        SchedClock::time_point next;
+        bool repeating = false;
+    };
+    
+    std::mutex m_repeatMutex;
+    std::atomic<bool> m_repeatEnabled{false};
+    SchedClock::duration m_repeatDelay{};
+    SchedClock::duration m_repeatPeriod{};
+    std::vector<RepeatKey> m_repeatHeld;
+    SchedClock::time_point m_repeatGrid;  // next shared tick
+    bool m_repeatRunning = false;
+    
+    // Track key edges leaving through uinput. Buttons and repeat events
+    // themselves are ignored.
+    void noteInjectedKeys(const struct input_event* events, size_t count) {
+        if (!m_repeatEnabled.load(std::memory_order_relaxed)) return;
+        bool edges = false;
+        for (size_t i = 0; i < count && !edges; i++) {
+            edges = events[i].type == EV_KEY && events[i].code < BTN_MISC && events[i].value != 2;
+        }
+        if (!edges) return;
         
-        if (vkToEvdev.count(vkCode)) {
-            return vkToEvdev[vkCode];
+        std::lock_guard<std::mutex> lock(m_repeatMutex);
+        auto now = SchedClock::now();
+        for (size_t i = 0; i < count; i++) {
+            const struct input_event& ev = events[i];
+            if (ev.type != EV_KEY || ev.code >= BTN_MISC || ev.value == 2) continue;
+            auto it = std::find_if(m_repeatHeld.begin(), m_repeatHeld.end(),
+                                   [&](const RepeatKey& k) { return k.code == ev.code; });
+            if (ev.value == 0) {
+                if (it != m_repeatHeld.end()) m_repeatHeld.erase(it);
+            } else if (it != m_repeatHeld.end()) {
+                *it = {ev.code, now + m_repeatDelay, false};
+            } else {
+                m_repeatHeld.push_back({ev.code, now + m_repeatDelay, false});
+            }
+        }
+        if (!m_repeatHeld.empty() && !m_repeatRunning) {
+            m_repeatRunning = true;
+            scheduleTask(now + m_repeatDelay,
+                         [this](SchedClock::time_point& due, EventBatch& batch) { return repeatTick(due, batch); },
+                         [this](EventBatch&) { stopRepeat(); });
         }
-        return vkCode;
     }
     
-    // Convert evdev codes back to Windows VK codes
-    unsigned int fromEvdevCode(unsigned int evdevCode) {
-        static std::unordered_map<unsigned int, unsigned int> evdevToVk = {
-            {KEY_A, 0x41}, {KEY_B, 0x42}, {KEY_C, 0x43}, {KEY_D, 0x44},
-            {KEY_E, 0x45}, {KEY_F, 0x46}, {KEY_G, 0x47}, {KEY_H, 0x48},
-            {KEY_I, 0x49}, {KEY_J, 0x4A}, {KEY_K, 0x4B}, {KEY_L, 0x4C},
-            {KEY_M, 0x4D}, {KEY_N, 0x4E}, {KEY_O, 0x4F}, {KEY_P, 0x50},
-            {KEY_Q, 0x51}, {KEY_R, 0x52}, {KEY_S, 0x53}, {KEY_T, 0x54},
-            {KEY_U, 0x55}, {KEY_V, 0x56}, {KEY_W, 0x57}, {KEY_X, 0x58},
-            {KEY_Y, 0x59}, {KEY_Z, 0x5A},
-            {KEY_0, 0x30}, {KEY_1, 0x31}, {KEY_2, 0x32}, {KEY_3, 0x33},
-            {KEY_4, 0x34}, {KEY_5, 0x35}, {KEY_6, 0x36}, {KEY_7, 0x37},
-            {KEY_8, 0x38}, {KEY_9, 0x39},
-            {KEY_F1, 0x70}, {KEY_F2, 0x71}, {KEY_F3, 0x72}, {KEY_F4, 0x73},
-            {KEY_F5, 0x74}, {KEY_F6, 0x75}, {KEY_F7, 0x76}, {KEY_F8, 0x77},
-            {KEY_F9, 0x78}, {KEY_F10, 0x79}, {KEY_F11, 0x7A}, {KEY_F12, 0x7B},
-            {KEY_SPACE, 0x20}, {KEY_ENTER, 0x0D}, {KEY_TAB, 0x09},
-            {KEY_ESC, 0x1B}, {KEY_LEFTSHIFT, 0xA0}, {KEY_RIGHTSHIFT, 0xA1},
-            {KEY_LEFTCTRL, 0xA2}, {KEY_RIGHTCTRL, 0xA3},
-            {KEY_LEFTALT, 0xA4}, {KEY_RIGHTALT, 0xA5},
-            {KEY_LEFTBRACE, 0xDB}, {KEY_RIGHTBRACE, 0xDD}, {KEY_SLASH, 0xBF}, {KEY_SEMICOLON, 0xBA},
-            {0xBF, KEY_SLASH},      // /
-            {0xBA, KEY_SEMICOLON},  // ; or :
-            {0x31, KEY_1},          // 1
-            {0x32, KEY_2},          // 2
-            {0x33, KEY_3},          // 3
-            {0x34, KEY_4},          // 4
-            {0x35, KEY_5},          // 5
-            {0x36, KEY_6},          // 6
-            {0x37, KEY_7},          // 7
-            {0x38, KEY_8},          // 8
-            {0x39, KEY_9},          // 9
-            {0x30, KEY_0},          // 0
-            {0xBD, KEY_MINUS},      // - or _
-            {0xBB, KEY_EQUAL},      // = or +
-            {0xDC, KEY_BACKSLASH},  // \ or |
-            {0xDE, KEY_APOSTROPHE}, // ' or "
-            {0xBC, KEY_COMMA},      // , or <
-            {0xBE, KEY_DOT},        // . or >
-            {0xC0, KEY_GRAVE},      // ` or ~
-            // Navigation keys
-            {KEY_HOME, 0x24}, {KEY_END, 0x23}, {KEY_PAGEUP, 0x21}, {KEY_PAGEDOWN, 0x22},
-            // Numpad
-            {KEY_KP0, 0x60}, {KEY_KP1, 0x61}, {KEY_KP2, 0x62}, {KEY_KP3, 0x63},
-            {KEY_KP4, 0x64}, {KEY_KP5, 0x65}, {KEY_KP6, 0x66}, {KEY_KP7, 0x67},
-            {KEY_KP8, 0x68}, {KEY_KP9, 0x69},
-            {KEY_KPASTERISK, 0x6A}, {KEY_KPPLUS, 0x6B}, {KEY_KPMINUS, 0x6D},
-            {KEY_KPDOT, 0x6E}, {KEY_KPSLASH, 0x6F},
-            // Lock keys
-            {KEY_CAPSLOCK, 0x14}, {KEY_NUMLOCK, 0x90}, {KEY_SCROLLLOCK, 0x91},
-            // System keys
-            {KEY_SYSRQ, 0x2C}, {KEY_PAUSE, 0x13},
-            // Windows/Super key
-            {KEY_LEFTMETA, 0x5B}, {KEY_RIGHTMETA, 0x5C},
-            // Arrow keys (if not already there)
-            {KEY_LEFT, 0x25}, {KEY_UP, 0x26}, {KEY_RIGHT, 0x27}, {KEY_DOWN, 0x28},
-            // Backspace, Delete, Insert (if not already there)
-            {KEY_BACKSPACE, 0x08}, {KEY_DELETE, 0x2E}, {KEY_INSERT, 0x2D},
-
-        };
+    // Every key due this tick repeats in the same report
+    bool repeatTick(SchedClock::time_point& due, EventBatch& batch) {
+        std::lock_guard<std::mutex> lock(m_repeatMutex);
+        if (!m_repeatEnabled.load(std::memory_order_relaxed) || m_repeatHeld.empty()) {
+            m_repeatHeld.clear();
+            m_repeatRunning = false;
+            return false;
+        }
+        auto now = SchedClock::now();
+        bool gridActive = false;
+        bool fired = false;
+        for (RepeatKey& key : m_repeatHeld) {
+            gridActive = gridActive || key.repeating;
+            if (key.next <= now) {
+                batch.add(EV_KEY, key.code, 2);
+                key.repeating = true;
+                fired = true;
+            }
+        }
+        endReport(batch);
         
+        if (fired) {
+            m_repeatGrid = (gridActive ? catchUp(m_repeatGrid, now) : now) + m_repeatPeriod;
+        }
+        due = SchedClock::time_point::max();
+        for (RepeatKey& key : m_repeatHeld) {
+            if (key.repeating) {
+                key.next = m_repeatGrid;
+            } else if (fired || gridActive) {
+                // Round the first repeat up onto the grid
+                auto ahead = key.next - m_repeatGrid;
+                auto ticks = ahead > ahead.zero() ? (ahead + m_repeatPeriod - SchedClock::duration(1)) / m_repeatPeriod : 0;
+                key.next = m_repeatGrid + ticks * m_repeatPeriod;
+            }
+            due = std::min(due, key.next);
+        }
+        return true;
+    }
+    
+    void stopRepeat() {
+        std::lock_guard<std::mutex> lock(m_repeatMutex);
+        m_repeatHeld.clear();
+        m_repeatRunning = false;
+    }
+#endif
 
-        if (evdevToVk.count(evdevCode)) {
-            return evdevToVk[evdevCode];
+    std::mutex m_schedMutex;
+    std::condition_variable m_schedCv;
+    std::condition_variable m_schedDoneCv;
+    std::thread m_schedThread;
+    bool m_schedRunning = false;
+    uint64_t m_schedGeneration = 0;  // bumped each time a scheduler thread starts or stops
+    std::vector<std::pair<SchedClock::time_point, TaskId>> m_schedQueue;  // min-heap
+    std::unordered_map<TaskId, std::shared_ptr<ScheduledTask>> m_schedTasks;
+    std::unordered_map<TaskId, std::shared_ptr<AutoclickState>> m_autoclicks;
+    std::unordered_map<TaskId, AutoclickStats> m_finishedAutoclicks;
+#ifndef _WIN32
+    std::unordered_map<TaskId, std::shared_ptr<ReplayState>> m_replays;
+    std::unordered_map<TaskId, ReplayStats> m_finishedReplays;
+#endif
+    // Final stats are kept for this many finished tasks, oldest dropped first
+    static constexpr size_t kFinishedStatsKept = 64;
+    std::deque<TaskId> m_finishedOrder;
+    TaskId m_nextTaskId = 1;
+    EventBatch m_schedBatch;  // reactor, pump() and stopScheduler()
+    std::vector<KeyWaiter> m_keyWaiters;
+    std::atomic<size_t> m_keyWaiterCount{0};  // lets key edges skip the lock
+    TaskId m_runningTaskId = 0;               // scheduler thread only
+    bool m_runningKeyWoken = false;           // scheduler thread only
+
+    // From inside a task: true if `key` already is down (or up). Otherwise
+    // the task resumes on that key edge, or at `due` if it comes first, so
+    // it sets `due` to its timeout or kTaskParked before calling this.
+    bool awaitKey(Key key, bool down, SchedClock::time_point& due) {
+#ifdef _WIN32
+        // The hook only sees the keyboard, so mouse buttons are polled
+        if (isMouseButton(key)) {
+            if (isKeyPressed(key) == down) return true;
+            due = std::min(due, SchedClock::now() + std::chrono::milliseconds(1));
+            return false;
         }
-        return evdevCode;
+#else
+        (void)due;  // every key edge reaches the listener
+#endif
+        {
+            std::lock_guard<std::mutex> lock(m_schedMutex);
+            auto it = m_schedTasks.find(m_runningTaskId);
+            if (it == m_schedTasks.end()) return isKeyPressed(key) == down;
+            it->second->keyWaiting = true;
+            m_keyWaiters.push_back({m_runningTaskId, static_cast<unsigned int>(key), down});
+            m_keyWaiterCount.fetch_add(1, std::memory_order_relaxed);
+        }
+        // Registered before checking, so an edge in between is not lost
+        if (isKeyPressed(key) != down) return false;
+        std::lock_guard<std::mutex> lock(m_schedMutex);
+        dropKeyWaiter(m_runningTaskId);
+        // An edge may have woken us meanwhile; the task goes on now, so its
+        // entry is stale and the deadline it returns must be kept
+        auto it = m_schedTasks.find(m_runningTaskId);
+        if (it != m_schedTasks.end() && it->second->keyWoken) {
+            it->second->keyWoken = false;
+            it->second->due = kTaskParked;
+        }
+        return true;
     }
 
-    
-    Key getCurrentPressedKeyLinux(int timeout_ms) {
-        auto startTime = std::chrono::steady_clock::now();
+    // Whether this run of the current task was started by its key edge
+    bool resumedByKey() const {
+        return m_runningKeyWoken;
+    }
+
+    // Caller holds m_schedMutex
+    void dropKeyWaiter(TaskId id) {
+        for (size_t i = 0; i < m_keyWaiters.size(); ++i) {
+            if (m_keyWaiters[i].task != id) continue;
+            m_keyWaiters[i] = m_keyWaiters.back();
+            m_keyWaiters.pop_back();
+            m_keyWaiterCount.fetch_sub(1, std::memory_order_relaxed);
+            break;
+        }
+        auto it = m_schedTasks.find(id);
+        if (it != m_schedTasks.end()) it->second->keyWaiting = false;
+    }
+
+    // A finished or cancelled task lets go of its autoclick or replay state
+    // (and the recording's mapping), keeping only the final stats. Caller
+    // holds m_schedMutex.
+    void retireTaskState(TaskId id) {
+        auto click = m_autoclicks.find(id);
+        if (click != m_autoclicks.end()) {
+            keepFinishedAutoclick(id, click->second->stats());
+            m_autoclicks.erase(click);
+        }
+#ifndef _WIN32
+        auto replay = m_replays.find(id);
+        if (replay != m_replays.end()) {
+            keepFinishedReplay(id, replayStats(*replay->second));
+            m_replays.erase(replay);
+        }
+#endif
+    }
+
+    // Caller holds m_schedMutex
+    void keepFinishedAutoclick(TaskId id, const AutoclickStats& stats) {
+        m_finishedAutoclicks[id] = stats;
+        noteFinishedStats(id);
+    }
+
+#ifndef _WIN32
+    // Caller holds m_schedMutex
+    void keepFinishedReplay(TaskId id, const ReplayStats& stats) {
+        m_finishedReplays[id] = stats;
+        noteFinishedStats(id);
+    }
+#endif
+
+    // Caller holds m_schedMutex
+    void noteFinishedStats(TaskId id) {
+        m_finishedOrder.push_back(id);
+        if (m_finishedOrder.size() <= kFinishedStatsKept) return;
+        TaskId oldest = m_finishedOrder.front();
+        m_finishedOrder.pop_front();
+        m_finishedAutoclicks.erase(oldest);
+#ifndef _WIN32
+        m_finishedReplays.erase(oldest);
+#endif
+    }
+
+    // Called by the listener (or hook) on every key edge: resumes the
+    // tasks waiting for it right away
+    void notifyKeyWaiters(unsigned int key, bool down) {
+        if (m_keyWaiterCount.load(std::memory_order_relaxed) == 0) return;
+        std::lock_guard<std::mutex> lock(m_schedMutex);
+        auto now = SchedClock::now();
+        bool woke = false;
+        for (size_t i = 0; i < m_keyWaiters.size();) {
+            const KeyWaiter& waiter = m_keyWaiters[i];
+            if (waiter.key != key || waiter.down != down) {
+                ++i;
+                continue;
+            }
+            auto it = m_schedTasks.find(waiter.task);
+            if (it != m_schedTasks.end()) {
+                ScheduledTask& task = *it->second;
+                task.keyWaiting = false;
+                task.keyWoken = true;
+                task.due = now;
+                pushSchedEntry(now, waiter.task);
+                woke = true;
+            }
+            m_keyWaiters[i] = m_keyWaiters.back();
+            m_keyWaiters.pop_back();
+            m_keyWaiterCount.fetch_sub(1, std::memory_order_relaxed);
+        }
+        if (woke) wakeScheduler();
+    }
+
+    // Run a task now instead of at its deadline, e.g. from a key edge
+    void wakeTask(TaskId id) {
+        std::lock_guard<std::mutex> lock(m_schedMutex);
+        auto it = m_schedTasks.find(id);
+        if (it == m_schedTasks.end()) return;
+        ScheduledTask& task = *it->second;
+        if (task.keyWaiting) dropKeyWaiter(id);
+        task.keyWoken = true;
+        task.due = SchedClock::now();
+        pushSchedEntry(task.due, id);
+        wakeScheduler();
+    }
+
+    // Caller holds m_schedMutex
+    void pushSchedEntry(SchedClock::time_point due, TaskId id) {
+        m_schedQueue.push_back({due, id});
+        std::push_heap(m_schedQueue.begin(), m_schedQueue.end(), std::greater<>());
+    }
+
+    // Caller holds m_schedMutex. Starts the scheduler thread on demand, or
+    // wakes the reactor when it runs the tasks instead.
+    void wakeScheduler() {
+#ifndef _WIN32
+        if (m_reactorFd >= 0) {
+            if (!onReactorThread()) wakeReactor();
+            return;
+        }
+#else
+        if (m_initialized && m_options.mode == Mode::Manual) return;  // pump() runs the tasks
+#endif
+        if (!m_schedRunning) {
+            // Whoever stopped the previous thread took it and joins it
+            // outside the lock, so m_schedThread is free here
+            m_schedRunning = true;
+            uint64_t generation = ++m_schedGeneration;
+            m_schedThread = std::thread([this, generation]() { schedulerLoop(generation); });
+            configureThread(m_schedThread, "inpctrl-sched");
+        }
+        m_schedCv.notify_all();
+    }
+
+    TaskId scheduleTask(SchedClock::time_point due,
+                        std::function<bool(SchedClock::time_point&, EventBatch&)> run,
+                        std::function<void(EventBatch&)> onStop = nullptr) {
+        auto task = std::make_shared<ScheduledTask>();
+        task->run = std::move(run);
+        task->onStop = std::move(onStop);
+        task->due = due;
         
-        do {
-            unsigned int pressedKeyCode = 0;
-            bool keyFound = false;
+        std::lock_guard<std::mutex> lock(m_schedMutex);
+        TaskId id = m_nextTaskId++;
+        m_schedTasks[id] = task;
+        pushSchedEntry(due, id);
+        wakeScheduler();
+        return id;
+    }
+
+    // Run every task that is due, then flush their combined output.
+    // Caller holds m_schedMutex through `lock`; it is released around tasks.
+    // A scheduler thread passes its generation and returns once that is
+    // stale, leaving the remaining tasks to whoever runs them now.
+    void runDueTasks(std::unique_lock<std::mutex>& lock, EventBatch& batch, uint64_t generation = 0) {
+        auto now = SchedClock::now();
+        while (!m_schedQueue.empty() && m_schedQueue.front().first <= now) {
+            if (generation && generation != m_schedGeneration) break;
+            std::pop_heap(m_schedQueue.begin(), m_schedQueue.end(), std::greater<>());
+            auto entry = m_schedQueue.back();
+            m_schedQueue.pop_back();
             
-            // Check for pressed keys in a scoped lock
-            {
-                std::lock_guard<std::mutex> lock(m_keyMutex);
-                
-                // Find the first pressed key
-                for (const auto& pair : m_keyStates) {
-                    if (pair.second) {
-                        pressedKeyCode = pair.first;
-                        keyFound = true;
-                        break;
-                    }
-                }
-            } // Lock is released here
+            auto it = m_schedTasks.find(entry.second);
+            if (it == m_schedTasks.end()) continue;  // stale entry of a finished task
+            std::shared_ptr<ScheduledTask> task = it->second;
             
-            // If we found a pressed key, wait for it to be released
-            if (keyFound) {
-                bool released = false;
-                while (!released) {
-                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
-                    
-                    // Check if key is still pressed
-                    std::lock_guard<std::mutex> lock(m_keyMutex);
-                    auto it = m_keyStates.find(pressedKeyCode);
-                    released = (it == m_keyStates.end() || !it->second);
-                }
-                
-                return static_cast<Key>(pressedKeyCode);
+            if (task->cancelled) {
+                if (task->keyWaiting) dropKeyWaiter(entry.second);
+                m_schedTasks.erase(it);
+                retireTaskState(entry.second);
+                lock.unlock();
+                if (task->onStop) task->onStop(batch);
+                lock.lock();
+                m_schedDoneCv.notify_all();
+                continue;
             }
             
-            if (timeout_ms == 0) {
-                break; // No wait, check once
-            }
+            if (entry.first != task->due) continue;  // superseded by a key edge
+            if (task->keyWaiting) dropKeyWaiter(entry.second);  // timed out first
+            m_runningTaskId = entry.second;
+            m_runningKeyWoken = task->keyWoken;
+            task->keyWoken = false;
             
-            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            SchedClock::time_point due = entry.first;
+            m_timerLatency.record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - due).count()));
+            lock.unlock();
+            bool again = task->run(due, batch);
+            lock.lock();
+            m_runningTaskId = 0;
             
-            if (timeout_ms > 0) {
-                auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
-                    std::chrono::steady_clock::now() - startTime
-                ).count();
-                if (elapsed >= timeout_ms) {
-                    break;
-                }
+            if (task->cancelled) continue;  // cancelTask() queued its own entry
+            if (again) {
+                if (task->keyWoken) continue;  // its key edge already requeued it
+                task->due = due;
+                if (due != kTaskParked) pushSchedEntry(due, entry.second);
+            } else {
+                if (task->keyWaiting) dropKeyWaiter(entry.second);
+                m_schedTasks.erase(entry.second);
+                retireTaskState(entry.second);
+                m_schedDoneCv.notify_all();
             }
-            
-        } while (timeout_ms != 0);
+        }
         
-        return static_cast<Key>(0); // No key pressed
+        // Motion and wheel output of all tasks due now share the open report
+        endReport(batch);
+        if (!batch.empty()) {
+            lock.unlock();
+            emitBatch(batch);
+            lock.lock();
+        }
     }
 
+    // A stopped thread may still be waiting for the lock or finishing a task
+    // when the tasks move on; the generation tells it to leave them alone
+    void schedulerLoop(uint64_t generation) {
+        prepareThread();
+        // Its own batch, as a stopped thread may still be filling it while
+        // the reactor or the next thread fills m_schedBatch
+        EventBatch batch;
+#ifndef _WIN32
+        if (m_options.prefaultBytes > 0) {
+            batch.events.resize(4096);
+            batch.clear();
+        }
 #endif
+        std::unique_lock<std::mutex> lock(m_schedMutex);
+        while (m_schedRunning && generation == m_schedGeneration) {
+            runDueTasks(lock, batch, generation);
+            if (!m_schedRunning || generation != m_schedGeneration) break;
+            // Re-read the front under the lock so a newly added earlier task
+            // cannot slip in between computing the deadline and waiting
+            if (m_schedQueue.empty()) {
+                m_schedCv.wait(lock);
+            } else {
+                m_schedCv.wait_until(lock, m_schedQueue.front().first);
+            }
+        }
+    }
+
+    // Let the scheduler thread exit but keep its tasks, for the reactor or
+    // pump() to run
+    void stopSchedulerThread() {
+        std::thread thread;
+        {
+            std::lock_guard<std::mutex> lock(m_schedMutex);
+            m_schedRunning = false;
+            ++m_schedGeneration;  // a thread stopped from its own task quits after it
+            m_schedCv.notify_all();
+            thread = std::move(m_schedThread);
+        }
+        joinSchedulerThread(thread);
+    }
+
+    // Called without m_schedMutex, which the thread needs to exit. From a
+    // task on that thread it cannot be joined; it exits once the task returns.
+    static void joinSchedulerThread(std::thread& thread) {
+        if (!thread.joinable()) return;
+        if (thread.get_id() == std::this_thread::get_id()) {
+            thread.detach();
+        } else {
+            thread.join();
+        }
+    }
+
+    void stopScheduler() {
+        std::unordered_map<TaskId, std::shared_ptr<ScheduledTask>> remaining;
+        std::thread thread;
+        {
+            std::lock_guard<std::mutex> lock(m_schedMutex);
+            m_schedRunning = false;
+            ++m_schedGeneration;  // a thread stopped from its own task quits after it
+            m_schedCv.notify_all();
+            thread = std::move(m_schedThread);
+        }
+        joinSchedulerThread(thread);
+        
+        {
+            std::lock_guard<std::mutex> lock(m_schedMutex);
+            remaining.swap(m_schedTasks);
+            for (auto& entry : remaining) retireTaskState(entry.first);
+            m_schedQueue.clear();
+            m_keyWaiters.clear();
+            m_keyWaiterCount = 0;
+        }
+        for (auto& entry : remaining) {
+            if (entry.second->onStop) entry.second->onStop(m_schedBatch);
+        }
+        endReport(m_schedBatch);
+        emitBatch(m_schedBatch);
+        m_schedDoneCv.notify_all();
+    }
 };
 
 #ifdef _WIN32
@@ -42,32 +42,20 @@ void testMouseMovement(CrossInput& input) {
     std::this_thread::sleep_for(std::chrono::seconds(1));
     
     int distance = 100;
-    int steps = 20;
-    int stepSize = distance / steps;
+    int durationMs = 400;
     
     std::cout << "Moving right... ";
-    for (int i = 0; i < steps; i++) {
-        input.moveMouse(stepSize, 0);
-        std::this_thread::sleep_for(std::chrono::milliseconds(20));
-    }
+    input.waitTask(input.moveMousePath(distance, 0, durationMs, CrossInput::PathCurve::EaseInOut));
     
     std::cout << "down... ";
-    for (int i = 0; i < steps; i++) {
-        input.moveMouse(0, stepSize);
-        std::this_thread::sleep_for(std::chrono::milliseconds(20));
-    }
+    input.waitTask(input.moveMousePath(0, distance, durationMs, CrossInput::PathCurve::EaseInOut));
     
     std::cout << "left... ";
-    for (int i = 0; i < steps; i++) {
-        input.moveMouse(-stepSize, 0);
-        std::this_thread::sleep_for(std::chrono::milliseconds(20));
-    }
+    input.waitTask(input.moveMousePath(-distance, 0, durationMs, CrossInput::PathCurve::EaseInOut));
     
-    std::cout << "up... Done!\n";
-    for (int i = 0; i < steps; i++) {
-        input.moveMouse(0, -stepSize);
-        std::this_thread::sleep_for(std::chrono::milliseconds(20));
-    }
+    std::cout << "up... ";
+    input.waitTask(input.moveMousePath(0, -distance, durationMs, CrossInput::PathCurve::EaseInOut));
+    std::cout << "Done!\n";
 }
 
 void testRapidKeyPresses(CrossInput& input) {